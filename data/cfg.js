@@ -10,7 +10,7 @@
 
 // Default settings 22.05.2023
 const defaultObj = JSON.parse(
-	'{"cfgApSsid":"Sunny5-Tinybox","cfgApPass":"12345678","cfgCntWb":1,"cfgMbCycleTime":10,"cfgMbDelay":100,"cfgMbTimeout":60000,"cfgStandby":4,"cfgFailsafeCurrent":0,"cfgMqttIp":"smartbox.local","cfgMqttLp":[1],"cfgMqttPort":1883,"cfgMqttUser":"","cfgMqttPass":"","cfgMqttWattTopic":"tinybox/pv/setWatt","cfgMqttWattJson":"","cfgNtpServer":"europe.pool.ntp.org","cfgFoxUser":"","cfgFoxPass":"","cfgFoxDevId":"","cfgPvActive":0,"cfgPvCycleTime":30,"cfgPvLimStart":61,"cfgPvLimStop":50,"cfgPvPhFactor":69,"cfgPvOffset":1,"cfgPvCalcMode":0,"cfgPvInvert":0,"cfgPvInvertBatt":0,"cfgPvMinTime":0,"cfgPvHttpIp":"","cfgPvHttpPath":"/","cfgPvHttpJson":"","cfgPvHttpPort":80,"cfgTotalCurrMax":0,"cfgHwVersion":15,"cfgWifiSleepMode":0,"cfgLoopDelay":2,"cfgKnockOutTimer":0,"cfgShellyIp":"","cfgInverterIp":"","cfgInverterType":0,"cfgInverterPort":0,"cfgInverterAddr":0,"cfgInvSmartAddr":0,"cfgInvRegToGrid":0,"cfgInvRegFromGrid":0,"cfgInvRegBattery":0,"cfgBootlogSize":2000,"cfgBtnDebounce":0,"cfgWifiConnectTimeout":10,"cfgResetOnTimeout":0,"cfgEnergyOffset":0,"cfgDisplayAutoOff":2,"cfgWifiAutoReconnect":1,"cfgLedIp":1,"cfgWifiOff":0,"cfgChargeLog":0,"cfgWbecMac":237,"cfgWbecIp":"","cfgModbusGWActive":0,"cfgRtu1BaudRate":19200,"cfgRtu1Parity":"8E1"}'
+	'{"cfgApSsid":"Sunny5-Tinybox","cfgApPass":"12345678","cfgCntWb":1,"cfgMbCycleTime":10,"cfgMbDelay":100,"cfgMbTimeout":60000,"cfgStandby":4,"cfgFailsafeCurrent":0,"cfgMqttIp":"smartbox.local","cfgMqttLp":[1],"cfgMqttPort":1883,"cfgMqttUser":"","cfgMqttPass":"","cfgMqttWattTopic":"tinybox/pv/setWatt","cfgMqttWattJson":"","cfgMqttMode":1,"cfgMqttRefresh":10,"cfgMqttDeadband":0,"cfgMqttAck":0,"cfgMqttLog":[2,1,1,0,0,2,2,2,2,1,0,2,1,1],"cfgMqttSpill":0,"cfgNtpServer":"europe.pool.ntp.org","cfgFoxUser":"","cfgFoxPass":"","cfgFoxDevId":"","cfgPvActive":0,"cfgPvCycleTime":30,"cfgPvLimStart":61,"cfgPvLimStop":50,"cfgPvPhFactor":69,"cfgPvOffset":1,"cfgPvCalcMode":0,"cfgPvInvert":0,"cfgPvInvertBatt":0,"cfgPvMinTime":0,"cfgPvHttpIp":"","cfgPvHttpPath":"/","cfgPvHttpJson":"","cfgPvHttpPort":80,"cfgTotalCurrMax":0,"cfgHwVersion":15,"cfgWifiSleepMode":0,"cfgLoopDelay":2,"cfgKnockOutTimer":0,"cfgShellyIp":"","cfgInverterIp":"","cfgInverterType":0,"cfgInverterPort":0,"cfgInverterAddr":0,"cfgInvSmartAddr":0,"cfgInvRegToGrid":0,"cfgInvRegFromGrid":0,"cfgInvRegBattery":0,"cfgBootlogSize":2000,"cfgBtnDebounce":0,"cfgWifiConnectTimeout":10,"cfgResetOnTimeout":0,"cfgEnergyOffset":0,"cfgDisplayAutoOff":2,"cfgWifiAutoReconnect":1,"cfgLedIp":1,"cfgWifiOff":0,"cfgChargeLog":0,"cfgWbecMac":237,"cfgWbecIp":"","cfgModbusGWActive":0,"cfgRtu1BaudRate":19200,"cfgRtu1Parity":"8E1","cfgMbServer":0,"cfgGwCacheTtl":0,"cfgGwUnitId":[],"cfgGwUnitTtl":[],"cfgGwMaxBlock":0,"cfgGwUnitBlock":[],"cfgGwPollUnit":[33],"cfgGwPollFc":[1],"cfgGwPollReg":[0],"cfgGwPollCnt":[1],"cfgGwPollTime":[60],"cfgGwPollJitter":0}'
 );
 
 const descObj = {
@@ -29,6 +29,12 @@ const descObj = {
 	cfgMqttPass            :"MQTT-Broker: Passwort (wenn nötig)",
 	cfgMqttWattTopic       :"MQTT: Topic, um den Wert Bezug/Einspeisung zu empfangen",
 	cfgMqttWattJson        :"MQTT: Suchstring, um den Wert Bezug/Einspeisung zu finden",
+	cfgMqttMode            :"MQTT: 1:ein Topic je Wert, 2:alle Werte als JSON in wbec/lp/N/state, 3:beides",
+	cfgMqttRefresh         :"[min] MQTT: Alle Topics neu senden, dazwischen nur Änderungen (0: immer alle Topics)",
+	cfgMqttDeadband        :"[W] MQTT: Min. Änderung der Leistung, die gesendet wird (0: jede Änderung)",
+	cfgMqttAck             :"MQTT: Bestätigung neuer Stromvorgaben mit Wert und Latenz in wbec/lp/N/ack: 0:inaktiv, 1:aktiv",
+	cfgMqttLog             :"MQTT: Log-Level je Modul für wbec/log (0:aus, 1:Warnungen, 2:alles), Reihenfolge: -,MB,MQTT,WEBS,GO-E,CFG,1P3P,LLOG,RFID,PFOX,SOCK,PV,SHLY,MBS",
+	cfgMqttSpill           :"[kB] MQTT: Max. Dateigröße für Ereignisse während Broker-Ausfall (0: nur RAM)",
 	cfgNtpServer           :"NTP-Server",
 	cfgPvActive            :"PV-Überschussregelung: 0:inaktiv, 1:aktiv",
 	cfgPvCycleTime         :"[s] PV-Überschussregelung: Zykluszeit",
@@ -70,9 +76,21 @@ const descObj = {
 	cfgChargeLog           :"Logbuch der Ladevorgänge: 0:inaktiv, 1:aktiv",
 	cfgWbecMac             :"(!) Letztes Byte der wbec-MAC-Adresse ändern (dez.)",
 	cfgWbecIp              :"(!) stat. IP-Adresse für wbec, z.B. 192.168.178.123",
-	cfgModbusGWActive	   :"Switch into Modbus RTU<->TCP Gateway mode: 0:inaktiv, 1:aktiv",
+	cfgModbusGWActive	   :"Switch into Modbus RTU<->TCP Gateway mode: 0:inaktiv, 1:aktiv, 2:aktiv + Wallbox-Steuerung (shared bus)",
 	cfgRtu1BaudRate		   :"Set baud rate for RS485 modbus rtu connector 1",
 	cfgRtu1Parity          :"Parity setting for RS485 modbus rtu connector 1, 8N1 or 8E1",
+	cfgMbServer            :"Modbus-TCP-Server (Port 502) mit den Registern der Wallboxen, Unit-ID = Bus-ID: 0:inaktiv, 1:aktiv",
+	cfgGwCacheTtl          :"[ms] Gateway: Answer repeated reads from cache, 0:inaktiv",
+	cfgGwUnitId            :"Gateway: RTU units with own settings, e.g. 33,1",
+	cfgGwUnitTtl           :"[ms] Gateway: Cache time per unit in cfgGwUnitId, e.g. 5000,500",
+	cfgGwMaxBlock          :"Gateway: Max. registers when merging overlapping reads, 0:inaktiv",
+	cfgGwUnitBlock         :"Gateway: Max. registers for merged reads per unit in cfgGwUnitId, e.g. 32,16",
+	cfgGwPollUnit          :"Gateway: Background requests: units, active after the first TCP request to the unit",
+	cfgGwPollFc            :"Gateway: Background requests: function code per entry, e.g. 1,3",
+	cfgGwPollReg           :"Gateway: Background requests: start address per entry",
+	cfgGwPollCnt           :"Gateway: Background requests: number of registers per entry",
+	cfgGwPollTime          :"[s] Gateway: Background requests: interval per entry",
+	cfgGwPollJitter        :"[ms] Gateway: Background requests: max. random delay",
 }
 
 
@@ -132,7 +150,7 @@ function storeCfg() {
 	// fetch data from the HTML page
 	var configObj = {};
 	for (const key in defaultObj) {
-		if (key == 'cfgMqttLp') {   // needs special array handling
+		if (Array.isArray(defaultObj[key])) {   // needs special array handling
 			var val = document.getElementById(key).value;
 			if (val != '') {
 				configObj[key] = val.split(',').map(Number);
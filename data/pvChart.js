@@ -8,17 +8,18 @@ var maxZoom = 3; // ~ 1 week
 var zoomLevel = 0;
 var viewportEndTime = new Date();
 var viewportStartTime = new Date();
+var chartsLoaded = false;
 
-loadCSV(); // Download the CSV data, load Google Charts, parse the data, and draw the chart
+loadCSV(); // Download the data of the viewport, load Google Charts, parse the data, and draw the chart
 
 
 /*
 Structure:
 
-    loadCSV
+    loadCSV (only the viewport, downsampled by the device to about one point per pixel)
         callback:
         parseCSV
-        load Google Charts (anonymous)
+        load Google Charts (anonymous, only once)
             callback:
             updateViewport
                 displayDate
@@ -38,15 +39,26 @@ viewportWidthTime = 1 day * 2^zoomLevel = viewportEndTime - viewportStartTime
 */
 
 function loadCSV() {
+    viewportStartTime = new Date(viewportEndTime.getTime() - getViewportWidthTime());
+    var from   = Math.floor(viewportStartTime.getTime() / 1000);
+    var to     = Math.ceil(viewportEndTime.getTime() / 1000);
+    var points = Math.min(Math.max(document.body.clientWidth, 100), 2000);
     var xmlhttp = new XMLHttpRequest();
     xmlhttp.onreadystatechange = function() {
         if (this.readyState == 4 && this.status == 200) {
             dataArray = parseCSV(this.responseText);
-            google.charts.load('current', { 'packages': ['line', 'corechart'] });
-            google.charts.setOnLoadCallback(updateViewport);
+            if (chartsLoaded) {
+                updateViewport();
+            } else {
+                google.charts.load('current', { 'packages': ['line', 'corechart'] });
+                google.charts.setOnLoadCallback(function() {
+                    chartsLoaded = true;
+                    updateViewport();
+                });
+            }
         }
     };
-    xmlhttp.open("GET", "pv.txt", true);
+    xmlhttp.open("GET", "pvdata?from=" + from + "&to=" + to + "&points=" + points, true);
     xmlhttp.send();
     var loadingdiv = document.getElementById("loading");
     loadingdiv.style.visibility = "visible";
@@ -57,6 +69,9 @@ function parseCSV(string) {
     var lines = string.split("\n");
     for (var i = 0; i < lines.length; i++) {
         var data = lines[i].split(";", 3);
+        if (data.length < 3) {
+            continue;
+        }
         data[0] = new Date(parseInt(data[0]) * 1000); 
         data[1] = parseInt(data[1]);
         data[2] = parseInt(data[2]);    //parseFloat
@@ -134,28 +149,28 @@ function displayDate() { // Display the start and end date on the page
 
 document.getElementById("prev").onclick = function() {
     viewportEndTime = new Date(viewportEndTime.getTime() - getViewportWidthTime()/3); // move the viewport to the left for one third of its width (e.g. if the viewport width is 3 days, move one day back in time)
-    updateViewport();
+    loadCSV();
 }
 document.getElementById("next").onclick = function() {
     viewportEndTime = new Date(viewportEndTime.getTime() + getViewportWidthTime()/3); // move the viewport to the right for one third of its width (e.g. if the viewport width is 3 days, move one day into the future)
-    updateViewport();
+    loadCSV();
 }
 
 document.getElementById("zoomout").onclick = function() {
     zoomLevel += 1; // increment the zoom level (zoom out)
     if(zoomLevel > maxZoom) zoomLevel = maxZoom;
-    else updateViewport();
+    else loadCSV();
 }
 document.getElementById("zoomin").onclick = function() {
     zoomLevel -= 1; // decrement the zoom level (zoom in)
     if(zoomLevel < minZoom) zoomLevel = minZoom;
-    else updateViewport();
+    else loadCSV();
 }
 
 document.getElementById("reset").onclick = function() {
     viewportEndTime = new Date(); // the end time of the viewport is the current time
     zoomLevel = 0; // reset the zoom level to the default (one day)
-    updateViewport();
+    loadCSV();
 }
 document.getElementById("refresh").onclick = function() {
     viewportEndTime = new Date(); // the end time of the viewport is the current time
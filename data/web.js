@@ -13,6 +13,7 @@ window.addEventListener('DOMContentLoaded', () => {
 
 		Socket = new WebSocket(`ws://${window.location.hostname}:81/`);
 		Socket.onmessage = processReceivedCommand;
+		Socket.onopen    = () => sendText('hb=1');   // values are sent on change, heartbeat each second for the time
 
 		document.getElementById('btnLog'). addEventListener('click', function() {window.location.href = "/log.html"});
 		document.getElementById('btnCfg'). addEventListener('click', function() {window.location.href = "/cfg.html"});
@@ -0,0 +1,182 @@
+// Copyright (c) 2023 steff393, MIT license
+
+#include <Arduino.h>
+#include "chargeLog.h"
+#include "globalConfig.h"
+#include "goEmulator.h"
+#include <LittleFS.h>
+#include "logger.h"
+#include "mbComm.h"
+#include "rfid.h"
+
+#define CYCLE_TIME      1000    // 1s
+#define CL_FILE         "/chargelog.bin"
+#define CL_MAGIC        0x43424C31UL   // "CBL1", changes when the layout changes
+#define CL_REC_CNT      256     // sessions in the ring, i.e. max. file size 72 + 256 * 32 byte
+#define CL_MAX_LEN      50      // max. sessions per request
+
+static const uint8_t m = 7;
+
+// The file starts with the index (header), followed by the ring of records. Every record
+// links to the previous session of the same box, so the last N sessions of a box are
+// found by reading N records, without scanning the file.
+typedef struct {
+	uint32_t magic;
+	uint32_t nextSeq;               // sequence number of the next record, starts with 1
+	uint32_t lastSeq[WB_CNT];       // last record per box, 0 = none
+} clHeader_t;
+
+typedef struct {
+	uint32_t seq;                   // the record is stored at (seq - 1) % CL_REC_CNT
+	uint32_t prevSeq;               // previous session of the same box, 0 = none
+	uint32_t start;                 // unixtime of plug-in
+	uint32_t duration;              // [s]
+	uint32_t energy;                // [Wh]
+	uint8_t  box;
+	uint8_t  res[3];
+	char     rfid[8];               // tag released at plug-in, not terminated (rfid_getLastID() has always 8 hex digits)
+} clRecord_t;
+
+typedef struct {
+	boolean  active;
+	uint16_t chgStat_old;
+	uint32_t start;
+	uint32_t energy;                // energy counter at plug-in [Wh]
+	char     rfid[8];
+} clSession_t;
+
+static clHeader_t  header;
+static clSession_t session[WB_CNT];
+static uint32_t    lastCall = 0;
+
+
+static uint32_t getEnergy(uint8_t id) {
+	return((uint32_t) content[id][13] << 16 | (uint32_t)content[id][14]);
+}
+
+
+static boolean recValid(uint32_t seq) {
+	// record exists and wasn't overwritten in the ring yet
+	return(seq != 0 && seq < header.nextSeq && header.nextSeq - seq <= CL_REC_CNT);
+}
+
+
+static uint32_t recPos(uint32_t seq) {
+	return(sizeof(clHeader_t) + ((seq - 1) % CL_REC_CNT) * sizeof(clRecord_t));
+}
+
+
+static void store(uint8_t id, uint32_t end) {
+	clRecord_t rec;
+	memset(&rec, 0, sizeof(rec));
+	rec.seq      = header.nextSeq;
+	rec.prevSeq  = recValid(header.lastSeq[id]) ? header.lastSeq[id] : 0;
+	rec.start    = session[id].start;
+	rec.duration = end - session[id].start;
+	rec.energy   = getEnergy(id) - session[id].energy;
+	rec.box      = id;
+	memcpy(rec.rfid, session[id].rfid, sizeof(rec.rfid));
+
+	File f = LittleFS.open(F(CL_FILE), "r+");
+	if (!f) {
+		LOGW(m, "Cannot open %s", CL_FILE);
+		return;
+	}
+	header.nextSeq++;
+	header.lastSeq[id] = rec.seq;
+	f.seek(recPos(rec.seq), SeekSet);
+	f.write((const uint8_t *)&rec, sizeof(rec));
+	f.seek(0, SeekSet);
+	f.write((const uint8_t *)&header, sizeof(header));
+	f.close();
+	LOG(m, "Box %d: session %d, %d Wh", id, rec.seq, rec.energy);
+}
+
+
+void chargeLog_setup() {
+	if (!cfgChargeLog) {
+		return;
+	}
+	File f = LittleFS.open(F(CL_FILE), "r");
+	if (!f || f.read((uint8_t *)&header, sizeof(header)) != sizeof(header) || header.magic != CL_MAGIC) {
+		// new or incompatible file: start with an empty index
+		if (f) {
+			f.close();
+		}
+		memset(&header, 0, sizeof(header));
+		header.magic   = CL_MAGIC;
+		header.nextSeq = 1;
+		f = LittleFS.open(F(CL_FILE), "w");
+		if (!f) {
+			LOGW(m, "Cannot create %s", CL_FILE);
+			return;
+		}
+		f.write((const uint8_t *)&header, sizeof(header));
+	}
+	f.close();
+}
+
+
+void chargeLog_loop() {
+	if (!cfgChargeLog || header.magic != CL_MAGIC || millis() - lastCall < CYCLE_TIME) {
+		return;
+	}
+	lastCall = millis();
+
+	for (uint8_t id = 0; id < cfgCntWb; id++) {
+		// same transitions as goE_handle() uses for the energy since plug-in
+		uint16_t chgStat = content[id][1];
+		if (!goE_plugged(session[id].chgStat_old) && goE_plugged(chgStat)) {
+			session[id].active = true;
+			session[id].start  = log_unixTime();
+			session[id].energy = getEnergy(id);
+			memset(session[id].rfid, 0, sizeof(session[id].rfid));
+			if (rfid_getEnabled()) {
+				strncpy(session[id].rfid, rfid_getLastID(), sizeof(session[id].rfid));
+			}
+		} else if (goE_plugged(session[id].chgStat_old) && !goE_plugged(chgStat) && session[id].active) {
+			session[id].active = false;
+			store(id, log_unixTime());
+		}
+		session[id].chgStat_old = chgStat;
+	}
+}
+
+
+String chargeLog_getJson(uint8_t id, uint8_t len) {
+	// the last 'len' sessions of the box, oldest first
+	uint32_t seq[CL_MAX_LEN];
+	uint8_t  cnt = 0;
+	String   response = F("{\"line\":[");
+	if (id >= WB_CNT || header.magic != CL_MAGIC) {
+		return(response + F("]}"));
+	}
+	len = min(len, (uint8_t)CL_MAX_LEN);
+
+	File f = LittleFS.open(F(CL_FILE), "r");
+	if (f) {
+		// follow the links of the box backwards
+		clRecord_t rec;
+		for (uint32_t s = header.lastSeq[id]; cnt < len && recValid(s); s = rec.prevSeq) {
+			f.seek(recPos(s), SeekSet);
+			if (f.read((uint8_t *)&rec, sizeof(rec)) != sizeof(rec) || rec.seq != s) {
+				break;
+			}
+			seq[cnt++] = s;
+		}
+		response.reserve(response.length() + cnt * 100);
+		for (int8_t i = cnt - 1; i >= 0; i--) {
+			f.seek(recPos(seq[i]), SeekSet);
+			f.read((uint8_t *)&rec, sizeof(rec));
+			char rfid[9];
+			memcpy(rfid, rec.rfid, sizeof(rec.rfid));
+			rfid[8] = '\0';
+			char line[100];
+			snprintf_P(line, sizeof(line), PSTR("%s{\"timestamp\":%lu,\"duration\":%lu,\"energy\":%lu,\"box\":%d,\"rfid\":\"%s\"}"),
+				i == cnt - 1 ? "" : ",", (unsigned long)rec.start, (unsigned long)rec.duration, (unsigned long)rec.energy, rec.box, rfid);
+			response += line;
+		}
+		f.close();
+	}
+	return(response + F("]}"));
+}
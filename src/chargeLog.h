@@ -0,0 +1,10 @@
+// Copyright (c) 2023 steff393, MIT license
+#ifndef CHARGELOG_H
+#define CHARGELOG_H
+
+
+extern void     chargeLog_setup();
+extern void     chargeLog_loop();
+extern String   chargeLog_getJson(uint8_t id, uint8_t len);
+
+#endif /* CHARGELOG_H */
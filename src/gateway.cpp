@@ -4,6 +4,8 @@
 #include <ArduinoJson.h>
 #include "globalConfig.h"
 #include "gateway.h"
+#include "mbComm.h"
+#include "mbServer.h"
 #ifdef ESP32
 #include <WiFi.h>
 #else
@@ -15,6 +17,18 @@
 #include <SoftwareSerial.h>
 
 #define BSIZE 1024
+#define GW_QUEUE_SIZE    8     // max. number of pending TCP requests (max. 8, see 'active')
+#define GW_CLIENT_MAX    4     // max. number of pending requests per client (IP)
+#define GW_PDU_MAX     253     // max. length of a Modbus PDU
+#define GW_MAX_WAIT   5000     // [ms] drop requests which waited longer (client has timed out anyway)
+#define GW_CACHE_SIZE    8     // number of cached read responses
+#define GW_CACHE_REGS   64     // max. number of registers in one cached response
+#define GW_BLOCK_MAX   125     // max. number of registers in one read request (Modbus limit)
+#define GW_STAT_UNITS    8     // number of units with own statistics
+#define GW_STAT_CLIENTS  4     // number of clients (IP) with own statistics
+#define GW_HIST_CNT      7     // number of buckets of the RTU latency histogram
+#define GW_JSON_LEN   3072
+
 uint8_t buf1[BSIZE];
 uint8_t buf2[BSIZE];
 StreamBuf S1(buf1, BSIZE);
@@ -27,14 +41,260 @@ static SoftwareSerial S;
 
 ModbusRTU rtu;
 ModbusTCP tcp;
-IPAddress srcIp;
+static ModbusRTU* bus = &rtu;    // RTU1, shared with the wallbox communication in shared-bus mode
+
+typedef struct gwReq_struct {
+  boolean  used;
+  uint32_t ip;                 // source IP of the TCP client
+  uint16_t transId;            // transaction id of the TCP request
+  uint8_t  unit;               // unit id (= RTU slave address)
+  uint8_t  len;                // length of pdu
+  uint32_t seq;                // arrival order
+  uint32_t rcvTime;            // millis() when received
+  uint8_t  pdu[GW_PDU_MAX];    // copy of the request, data of cbTcpRaw is only valid during the callback
+} gwReq_t;
+
+typedef struct gwCache_struct {
+  uint8_t  unit;               // unit id, 0 = empty entry
+  uint8_t  fc;                 // function code (0x03 or 0x04)
+  uint16_t addr;               // first register
+  uint16_t cnt;                // number of registers
+  uint32_t time;               // millis() when stored
+  uint8_t  data[GW_CACHE_REGS * 2];
+} gwCache_t;
+
+static gwReq_t  queue[GW_QUEUE_SIZE];
+static gwCache_t cache[GW_CACHE_SIZE];
+static uint32_t queueSeq  = 0;
+static uint8_t  active    = 0;   // bitmask of the slots, which are currently executed (several, when reads are merged)
+static boolean  grpRead   = false; // active requests are (merged) reads
+static uint8_t  grpUnit   = 0;   // unit of the active requests
+static uint8_t  grpPdu[5];       // read request sent to RTU side: fc, addr, cnt
+static uint32_t lastIp    = 0;   // client which was served last (for fairness)
+static uint32_t sentTime  = 0;   // millis() when the active request was sent to the RTU side
+
+// Statistics, 'total' counts everything, units and clients only the first GW_STAT_UNITS / GW_STAT_CLIENTS seen
+typedef enum {
+  ST_REQ = 0,                  // received requests
+  ST_CACHE,                    // answered from cache
+  ST_BUSY,                     // rejected, because queue was full
+  ST_SENT,                     // forwarded to RTU side
+  ST_TIMEOUT,                  // no response from RTU side
+  ST_DROPPED,                  // abandoned: waited too long or response couldn't be sent to the client
+  ST_WAIT,                     // [ms] sum of the time in the queue
+  ST_CNT
+} gwStatIdx_t;
+
+typedef struct gwStat_struct {
+  boolean  used;
+  uint32_t key;                // unit id or IP
+  uint32_t cnt[ST_CNT];
+  uint32_t waitMax;            // [ms] max. time in the queue
+  uint32_t rtt[GW_HIST_CNT];   // RTU round-trip times, units and total only
+} gwStat_t;
 
-uint16_t transRunning = 0;  // Currently executed ModbusTCP transaction
-uint8_t slaveRunning = 0;   // Current request slave
+static const uint16_t histLimit[GW_HIST_CNT - 1] = {25, 50, 100, 200, 500, 1000};  // [ms] upper limits of the buckets
+static gwStat_t statTotal;
+static gwStat_t statUnit[GW_STAT_UNITS];
+static gwStat_t statClient[GW_STAT_CLIENTS];
 
-const int minRequestInterval = 60; // minimal intervall to poll client
-unsigned long lastRequest = 0;
-uint8_t lastSlave = 0;
+typedef struct gwPoll_struct {
+  boolean  armed;              // unit was requested by a TCP client, so it's worth to keep it awake
+  uint32_t next;               // millis() when the request is due
+  uint16_t okCnt;              // successful requests
+  uint16_t errCnt;             // failed requests
+} gwPoll_t;
+
+static gwPoll_t pollState[GW_POLL_CNT];
+static int8_t   pollActive = -1; // background request currently executed, -1 if none
+static uint8_t  pollPdu[5];
+
+
+static gwStat_t* statGet(gwStat_t* tab, uint8_t size, uint32_t key) {
+  for (uint8_t i = 0; i < size; i++) {
+    if (!tab[i].used) {
+      tab[i].used = true;
+      tab[i].key  = key;
+    }
+    if (tab[i].key == key) {
+      return(&tab[i]);
+    }
+  }
+  return(NULL);   // table full
+}
+
+
+static void statAdd(gwStatIdx_t idx, uint8_t unit, uint32_t ip, uint32_t val = 1) {
+  gwStat_t* s[3] = { &statTotal, statGet(statUnit, GW_STAT_UNITS, unit), statGet(statClient, GW_STAT_CLIENTS, ip) };
+  for (uint8_t i = 0; i < 3; i++) {
+    if (s[i]) {
+      s[i]->cnt[idx] += val;
+      if (idx == ST_WAIT && val > s[i]->waitMax) {
+        s[i]->waitMax = val;
+      }
+    }
+  }
+}
+
+
+static void statRtt(uint8_t unit, uint32_t ms) {
+  uint8_t b = 0;
+  while (b < GW_HIST_CNT - 1 && ms > histLimit[b]) {
+    b++;
+  }
+  statTotal.rtt[b]++;
+  gwStat_t* s = statGet(statUnit, GW_STAT_UNITS, unit);
+  if (s) {
+    s->rtt[b]++;
+  }
+}
+
+
+static uint8_t queueCount(uint32_t ip) {
+  uint8_t cnt = 0;
+  for (uint8_t i = 0; i < GW_QUEUE_SIZE; i++) {
+    if (queue[i].used && (ip == 0 || queue[i].ip == ip)) {
+      cnt++;
+    }
+  }
+  return(cnt);
+}
+
+
+static void queueFree(int8_t slot) {
+  queue[slot].used = false;
+  active &= ~(1 << slot);
+}
+
+
+static int8_t queueNext() {
+  // oldest request of another client than the one served last, otherwise the oldest at all
+  int8_t next  = -1;
+  int8_t other = -1;
+  for (uint8_t i = 0; i < GW_QUEUE_SIZE; i++) {
+    if (!queue[i].used || (active & (1 << i))) {
+      continue;
+    }
+    if (next == -1 || queue[i].seq < queue[next].seq) {
+      next = i;
+    }
+    if (queue[i].ip != lastIp && (other == -1 || queue[i].seq < queue[other].seq)) {
+      other = i;
+    }
+  }
+  return(other != -1 ? other : next);
+}
+
+
+static uint16_t getWord(const uint8_t* data) {
+  return((uint16_t)data[0] << 8 | data[1]);
+}
+
+
+static uint16_t unitTtl(uint8_t unit) {
+  for (uint8_t i = 0; i < GW_UNIT_CNT; i++) {
+    if (cfgGwUnitId[i] == unit) {
+      return(cfgGwUnitTtl[i]);
+    }
+  }
+  return(cfgGwCacheTtl);
+}
+
+
+static uint8_t unitBlock(uint8_t unit) {
+  uint8_t block = cfgGwMaxBlock;
+  for (uint8_t i = 0; i < GW_UNIT_CNT; i++) {
+    if (cfgGwUnitId[i] == unit) {
+      block = cfgGwUnitBlock[i];
+      break;
+    }
+  }
+  return(block > GW_BLOCK_MAX ? GW_BLOCK_MAX : block);
+}
+
+
+static boolean isRead(const uint8_t* pdu, uint8_t len) {
+  return(len == 5 && (pdu[0] == Modbus::FC_READ_REGS || pdu[0] == Modbus::FC_READ_INPUT_REGS));
+}
+
+
+static int8_t cacheFind(uint8_t unit, uint8_t fc, uint16_t addr, uint16_t cnt) {
+  // find a valid entry which contains the requested registers, never for broadcasts (unit 0 marks empty entries)
+  if (unit == 0) {
+    return(-1);
+  }
+  uint16_t ttl = unitTtl(unit);
+  for (uint8_t i = 0; i < GW_CACHE_SIZE; i++) {
+    if (cache[i].unit == unit && cache[i].fc == fc && 
+        cache[i].addr <= addr && (uint32_t)addr + cnt <= (uint32_t)cache[i].addr + cache[i].cnt) {
+      if (millis() - cache[i].time < ttl) {
+        return(i);
+      }
+      cache[i].unit = 0;    // expired
+    }
+  }
+  return(-1);
+}
+
+
+static boolean writePending(uint8_t unit) {
+  for (uint8_t i = 0; i < GW_QUEUE_SIZE; i++) {
+    if (queue[i].used && !(active & (1 << i)) && (queue[i].unit == unit || queue[i].unit == 0) && !isRead(queue[i].pdu, queue[i].len)) {
+      return(true);
+    }
+  }
+  return(false);
+}
+
+
+static void cacheStore(uint8_t unit, uint8_t fc, uint16_t addr, uint16_t cnt, const uint8_t* regs) {
+  if (unit == 0 || cnt > GW_CACHE_REGS || unitTtl(unit) == 0 || writePending(unit)) {
+    return;   // don't store values, which might be outdated by a queued write
+  }
+  // take the same key, otherwise an empty or the oldest entry
+  int8_t slot = 0;
+  for (uint8_t i = 0; i < GW_CACHE_SIZE; i++) {
+    if (cache[i].unit == unit && cache[i].fc == fc && cache[i].addr == addr && cache[i].cnt == cnt) {
+      slot = i;
+      break;
+    }
+    if (cache[slot].unit != 0 && (cache[i].unit == 0 || cache[i].time < cache[slot].time)) {
+      slot = i;
+    }
+  }
+  cache[slot].unit = unit;
+  cache[slot].fc   = fc;
+  cache[slot].addr = addr;
+  cache[slot].cnt  = cnt;
+  cache[slot].time = millis();
+  memcpy(cache[slot].data, regs, cnt * 2);
+}
+
+
+static void cacheInvalidate(uint8_t unit, const uint8_t* pdu, uint8_t len) {
+  // a write to holding registers invalidates all overlapping entries (unit 0 = broadcast)
+  uint16_t addr;
+  uint16_t cnt;
+  switch (pdu[0]) {
+    case Modbus::FC_WRITE_REG:      if (len < 5) return; addr = getWord(&pdu[1]); cnt = 1;                 break;
+    case Modbus::FC_WRITE_REGS:     if (len < 5) return; addr = getWord(&pdu[1]); cnt = getWord(&pdu[3]);  break;
+    case Modbus::FC_MASKWRITE_REG:  if (len < 5) return; addr = getWord(&pdu[1]); cnt = 1;                 break;
+    case Modbus::FC_READWRITE_REGS: if (len < 9) return; addr = getWord(&pdu[5]); cnt = getWord(&pdu[7]);  break;
+    default: return;
+  }
+  for (uint8_t i = 0; i < GW_CACHE_SIZE; i++) {
+    if (cache[i].unit != 0 && (unit == 0 || cache[i].unit == unit) && cache[i].fc == Modbus::FC_READ_REGS &&
+        addr < cache[i].addr + cache[i].cnt && cache[i].addr < (uint32_t)addr + cnt) {
+      cache[i].unit = 0;
+    }
+  }
+}
+
+
+static void tcpError(int8_t slot, Modbus::ResultCode code) {
+  tcp.setTransactionId(queue[slot].transId); // Set transaction id as per incoming request
+  tcp.errorResponce(IPAddress(queue[slot].ip), (Modbus::FunctionCode)queue[slot].pdu[0], code);
+}
 
 
 bool cbTcpTrans(Modbus::ResultCode event, uint16_t transactionId, void* data) { // Modbus Transaction callback
@@ -43,20 +303,23 @@ bool cbTcpTrans(Modbus::ResultCode event, uint16_t transactionId, void* data) {
   if (event == Modbus::EX_TIMEOUT) {    // If Transaction timeout took place
     Serial.println("Timeout");
     tcp.disconnect(tcp.eventSource());          // Close connection
-    transRunning = 0;
-    slaveRunning = 0;
   }
   return true;
 }
 
 
 bool cbRtuTrans(Modbus::ResultCode event, uint16_t transactionId, void* data) {
-  if (event != Modbus::EX_SUCCESS)                  // If transaction got an error
+  if (event != Modbus::EX_SUCCESS && event != Modbus::EX_PASSTHROUGH)  // If transaction got an error
     Serial.printf("\nModbus RTU result: %02X, Mem: %d\n", event, ESP.getFreeHeap());  // Display Modbus error code (222527)
-  if (event == Modbus::EX_TIMEOUT) {    // If Transaction timeout took place
+  if (active) {   // no response was forwarded by cbRtuRaw, e.g. timeout
     Serial.println("Timeout");
-    transRunning = 0;
-    slaveRunning = 0;
+    for (uint8_t i = 0; i < GW_QUEUE_SIZE; i++) {
+      if (active & (1 << i)) {
+        statAdd(ST_TIMEOUT, queue[i].unit, queue[i].ip);
+        tcpError(i, Modbus::EX_DEVICE_FAILED_TO_RESPOND);
+        queueFree(i);
+      }
+    }
   }
   return true;
 }
@@ -66,62 +329,256 @@ bool cbRtuTrans(Modbus::ResultCode event, uint16_t transactionId, void* data) {
 Modbus::ResultCode cbTcpRaw(uint8_t* data, uint8_t len, void* custom) {
   auto src = (Modbus::frame_arg_t*) custom;
 
-  if (transRunning) { // Note that we can't process new requests from TCP-side while waiting for responce from RTU-side.
+  // Registers of the wallboxes are provided by the Modbus TCP server (shared-bus mode)
+  Modbus::ResultCode res = mbs_request(&tcp, data, len, src);
+  if (res != Modbus::EX_PASSTHROUGH) {
+    return res;
+  }
+  statAdd(ST_REQ, src->unitId, src->ipaddr);
+
+  // Answer reads directly from RAM, when the registers are in the cache
+  if (isRead(data, len)) {
+    uint16_t addr = getWord(&data[1]);
+    uint16_t cnt  = getWord(&data[3]);
+    if (cnt > GW_BLOCK_MAX) {   // Modbus limit, the merged response wouldn't fit
+      tcp.setTransactionId(src->transactionId); // Set transaction id as per incoming request
+      tcp.errorResponce(IPAddress(src->ipaddr), (Modbus::FunctionCode)data[0], Modbus::EX_ILLEGAL_VALUE);
+      return Modbus::EX_ILLEGAL_VALUE;
+    }
+    int8_t   hit  = cnt ? cacheFind(src->unitId, data[0], addr, cnt) : -1;
+    if (hit != -1) {
+      uint8_t resp[2 + GW_CACHE_REGS * 2];
+      resp[0] = data[0];
+      resp[1] = cnt * 2;
+      memcpy(&resp[2], &cache[hit].data[(addr - cache[hit].addr) * 2], cnt * 2);
+      tcp.setTransactionId(src->transactionId); // Set transaction id as per incoming request
+      tcp.rawResponce(IPAddress(src->ipaddr), resp, 2 + cnt * 2, src->unitId);
+      statAdd(ST_CACHE, src->unitId, src->ipaddr);
+      return Modbus::EX_SUCCESS;
+    }
+  }
+  cacheInvalidate(src->unitId, data, len);
+
+  // Requests are queued, as we can't process new requests from TCP-side while waiting for responce from RTU-side.
+  int8_t slot = -1;
+  for (uint8_t i = 0; i < GW_QUEUE_SIZE; i++) {
+    if (!queue[i].used) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot == -1 || len > GW_PDU_MAX || queueCount(src->ipaddr) >= GW_CLIENT_MAX) {
     Serial.print("TCP IP in - ");
     Serial.print(IPAddress(src->ipaddr));
     Serial.printf(" Fn: %02X, len: %d \n", data[0], len);
-    Serial.println("Trans running");
+    Serial.println("Queue full");
+    statAdd(ST_BUSY, src->unitId, src->ipaddr);
     tcp.setTransactionId(src->transactionId); // Set transaction id as per incoming request
     tcp.errorResponce(IPAddress(src->ipaddr), (Modbus::FunctionCode)data[0], Modbus::EX_SLAVE_DEVICE_BUSY);
     return Modbus::EX_SLAVE_DEVICE_BUSY;
   }
 
-  Serial.printf("Modbus RTU request to address: %d\n", src->unitId);
-  rtu.rawRequest(src->unitId, data, len, cbRtuTrans);
-  //LG heatpump always has modbus address 33
-  if (src->unitId == 33) {
-    lastRequest = millis();
-    lastSlave = src->unitId;
+  queue[slot].used    = true;
+  queue[slot].ip      = src->ipaddr;
+  queue[slot].transId = src->transactionId;
+  queue[slot].unit    = src->unitId;
+  queue[slot].len     = len;
+  queue[slot].seq     = queueSeq++;
+  queue[slot].rcvTime = millis();
+  memcpy(queue[slot].pdu, data, len);
+  return Modbus::EX_SUCCESS;
+}
+
+
+static void pollArm(uint8_t unit) {
+  for (uint8_t i = 0; i < GW_POLL_CNT; i++) {
+    if (cfgGwPollUnit[i] == unit && !pollState[i].armed) {
+      pollState[i].armed = true;
+      pollState[i].next  = millis() + (uint32_t)cfgGwPollTime[i] * 1000;
+    }
   }
+}
+
+
+static bool cbRtuPoll(Modbus::ResultCode event, uint16_t transactionId, void* data) {
+  if (pollActive != -1) {   // no response received by cbRtuRaw
+    Serial.printf("Background request %d failed: %02X\n", pollActive, event);
+    pollState[pollActive].errCnt++;
+    pollActive = -1;
+  }
+  return true;
+}
 
-  if (!src->unitId) { // If broadcast request (no responce from slave is expected)
-    tcp.setTransactionId(src->transactionId); // Set transaction id as per incoming request
-    tcp.errorResponce(IPAddress(src->ipaddr), (Modbus::FunctionCode)data[0], Modbus::EX_ACKNOWLEDGE);
 
-    transRunning = 0;
-    slaveRunning = 0;
-    return Modbus::EX_ACKNOWLEDGE;
+static void poll() {
+  // background requests only, when there is no live traffic
+  if (active || pollActive != -1 || bus->slave() || queueCount(0) || !mb_busFree()) {
+    return;
+  }
+  for (uint8_t i = 0; i < GW_POLL_CNT; i++) {
+    if (cfgGwPollUnit[i] == 0 || !pollState[i].armed || (int32_t)(millis() - pollState[i].next) < 0) {
+      continue;
+    }
+    pollState[i].next = millis() + (uint32_t)cfgGwPollTime[i] * 1000 + (cfgGwPollJitter ? random(cfgGwPollJitter) : 0);
+    pollPdu[0] = cfgGwPollFc[i];
+    pollPdu[1] = cfgGwPollReg[i] >> 8;
+    pollPdu[2] = cfgGwPollReg[i] & 0xFF;
+    pollPdu[3] = cfgGwPollCnt[i] >> 8;
+    pollPdu[4] = cfgGwPollCnt[i] & 0xFF;
+    if (bus->rawRequest(cfgGwPollUnit[i], pollPdu, sizeof(pollPdu), cbRtuPoll)) {
+      pollActive = i;
+      mb_busAcquire(MB_BUS_GW_BACKGROUND);
+    }
+    return;   // only one request per call
   }
+}
 
-  srcIp = IPAddress(src->ipaddr);
-  slaveRunning = src->unitId;
-  transRunning = src->transactionId;
-  return Modbus::EX_SUCCESS;
+
+static void merge(int8_t slot) {
+  // extend the read by all pending reads of the same unit, which overlap or are adjacent
+  uint16_t lo    = getWord(&queue[slot].pdu[1]);
+  uint32_t hi    = lo + getWord(&queue[slot].pdu[3]);
+  uint8_t  block = unitBlock(queue[slot].unit);
+  boolean  found = true;
+  while (found) {
+    found = false;
+    for (uint8_t i = 0; i < GW_QUEUE_SIZE; i++) {
+      if (!queue[i].used || (active & (1 << i)) || queue[i].unit != queue[slot].unit ||
+          queue[i].pdu[0] != queue[slot].pdu[0] || !isRead(queue[i].pdu, queue[i].len)) {
+        continue;
+      }
+      uint16_t a = getWord(&queue[i].pdu[1]);
+      uint32_t b = a + getWord(&queue[i].pdu[3]);
+      if (a <= hi && lo <= b && (max(hi, b) - min((uint32_t)lo, (uint32_t)a)) <= block) {
+        lo = min(lo, a);
+        hi = max(hi, b);
+        active |= 1 << i;
+        found = true;
+      }
+    }
+  }
+  grpPdu[0] = queue[slot].pdu[0];
+  grpPdu[1] = lo >> 8;
+  grpPdu[2] = lo & 0xFF;
+  grpPdu[3] = (hi - lo) >> 8;
+  grpPdu[4] = (hi - lo) & 0xFF;
+}
+
+
+static void dispatch() {
+  // drop requests, which waited too long, the client gets an exception instead of no response
+  for (uint8_t i = 0; i < GW_QUEUE_SIZE; i++) {
+    if (queue[i].used && !(active & (1 << i)) && millis() - queue[i].rcvTime > GW_MAX_WAIT) {
+      statAdd(ST_DROPPED, queue[i].unit, queue[i].ip);
+      tcpError(i, Modbus::EX_DEVICE_FAILED_TO_RESPOND);
+      queueFree(i);
+    }
+  }
+
+  if (active || pollActive != -1 || bus->slave() || !mb_busFree()) {  // RTU side still busy or wallbox traffic has priority
+    return;
+  }
+  int8_t slot = queueNext();
+  if (slot == -1) {
+    return;
+  }
+
+  lastIp  = queue[slot].ip;
+  active  = 1 << slot;
+  grpUnit = queue[slot].unit;
+  grpRead = isRead(queue[slot].pdu, queue[slot].len) && queue[slot].unit != 0;
+  uint8_t* pdu = queue[slot].pdu;
+  uint8_t  len = queue[slot].len;
+  if (grpRead) {
+    merge(slot);
+    pdu = grpPdu;
+    len = sizeof(grpPdu);
+  }
+
+  if (!bus->rawRequest(queue[slot].unit, pdu, len, cbRtuTrans)) {
+    for (uint8_t i = 0; i < GW_QUEUE_SIZE; i++) {
+      if (active & (1 << i)) {
+        tcpError(i, Modbus::EX_GENERAL_FAILURE);
+        queueFree(i);
+      }
+    }
+    return;
+  }
+  mb_busAcquire(MB_BUS_GW_LIVE);
+  pollArm(queue[slot].unit);
+  sentTime = millis();
+  for (uint8_t i = 0; i < GW_QUEUE_SIZE; i++) {
+    if (active & (1 << i)) {
+      statAdd(ST_SENT, queue[i].unit, queue[i].ip);
+      statAdd(ST_WAIT, queue[i].unit, queue[i].ip, sentTime - queue[i].rcvTime);
+    }
+  }
+
+  if (!queue[slot].unit) { // If broadcast request (no responce from slave is expected)
+    tcpError(slot, Modbus::EX_ACKNOWLEDGE);
+    queueFree(slot);
+  }
 }
 
 
-// Callback receives raw data from ModbusTCP and sends it on behalf of slave (slaveRunning) to master
+// Callback receives raw data from ModbusRTU and sends it on behalf of slave (unit of active requests) to master
 Modbus::ResultCode cbRtuRaw(uint8_t* data, uint8_t len, void* custom) {
+  static uint8_t resp[2 + 2 * GW_BLOCK_MAX];   // fc, byte count, registers
   auto src = (Modbus::frame_arg_t*) custom;
-  if (!transRunning) // Unexpected incoming data
+  if (!active) { // Response to a background request or unexpected incoming data
+    if (pollActive != -1) {
+      if (isRead(pollPdu, sizeof(pollPdu)) && data[0] == pollPdu[0] && len >= 2 && data[1] == getWord(&pollPdu[3]) * 2 && len == 2 + data[1]) {
+        cacheStore(cfgGwPollUnit[pollActive], data[0], getWord(&pollPdu[1]), getWord(&pollPdu[3]), &data[2]);
+      }
+      if (data[0] & 0x80) {
+        pollState[pollActive].errCnt++;   // exception response
+      } else {
+        pollState[pollActive].okCnt++;
+      }
+      pollActive = -1;
+    }
     return Modbus::EX_PASSTHROUGH;
-  tcp.setTransactionId(transRunning); // Set transaction id as per incoming request
-  uint16_t succeed = tcp.rawResponce(srcIp, data, len, slaveRunning);
-  if (!succeed) {
-    Serial.println("TCP IP out - failed");
-    Serial.printf("RTU Slave: %d, Fn: %02X, len: %d, ", src->slaveId, data[0], len);
-    Serial.print("Response TCP IP: ");
-    Serial.println(srcIp);
   }
 
-  transRunning = 0;
-  slaveRunning = 0;
+  // a valid read response can be split into the responses of the merged requests
+  boolean  split = grpRead && data[0] == grpPdu[0] && len >= 2 && data[1] == getWord(&grpPdu[3]) * 2 && len == 2 + data[1];
+  uint16_t lo    = getWord(&grpPdu[1]);
+  statRtt(grpUnit, millis() - sentTime);
+  if (split) {
+    cacheStore(grpUnit, data[0], lo, getWord(&grpPdu[3]), &data[2]);
+  }
+
+  for (uint8_t i = 0; i < GW_QUEUE_SIZE; i++) {
+    if (!(active & (1 << i))) {
+      continue;
+    }
+    uint16_t succeed;
+    tcp.setTransactionId(queue[i].transId); // Set transaction id as per incoming request
+    if (split) {
+      uint16_t cnt = getWord(&queue[i].pdu[3]);
+      resp[0] = data[0];
+      resp[1] = cnt * 2;
+      memcpy(&resp[2], &data[2 + (getWord(&queue[i].pdu[1]) - lo) * 2], cnt * 2);
+      succeed = tcp.rawResponce(IPAddress(queue[i].ip), resp, 2 + cnt * 2, queue[i].unit);
+    } else {
+      succeed = tcp.rawResponce(IPAddress(queue[i].ip), data, len, queue[i].unit);   // e.g. exception or write response
+      cacheInvalidate(queue[i].unit, queue[i].pdu, queue[i].len);
+    }
+    if (!succeed) {
+      Serial.println("TCP IP out - failed");
+      Serial.printf("RTU Slave: %d, Fn: %02X, len: %d, ", src->slaveId, data[0], len);
+      Serial.print("Response TCP IP: ");
+      Serial.println(IPAddress(queue[i].ip));
+      statAdd(ST_DROPPED, queue[i].unit, queue[i].ip);
+    }
+    queueFree(i);
+  }
   return Modbus::EX_PASSTHROUGH;
 }
 
 
 void gateway_setup() {
-    // Setup only when in gateway mode
+    // Setup only when in gateway mode (1) or shared-bus mode (2)
 	if (cfgModbusGWActive == 1) {
         //Serial.begin(9600, SERIAL_8E1);
         if (strcmp(cfgRtu1Parity, "8E1") == 0) {
@@ -131,30 +588,92 @@ void gateway_setup() {
           S.begin(cfgRtu1BaudRate, SWSERIAL_8N1, PIN_RO, PIN_DI);
         }
 
-        tcp.server(); // Initialize ModbusTCP to pracess as server
-        tcp.onRaw(cbTcpRaw); // Assign raw data processing callback
-
         rtu.begin(&S, PIN_DE_RE);  // Specify RE_DE control pin
         //rtu.begin(&S, PIN_DE_RE);
         rtu.master(); // Initialize ModbusRTU as master
-        rtu.onRaw(cbRtuRaw); // Assign raw data processing callback
-
-        Serial.println(F("\nRunning in Modbus RTU<->TCP Gateway mode now...\n"));
+    } else if (cfgModbusGWActive == 2) {
+        bus = mb_getBus();         // RTU1 is already set up by mb_setup()
+    } else {
+        return;
     }
+    tcp.server(); // Initialize ModbusTCP to pracess as server
+    tcp.onRaw(cbTcpRaw); // Assign raw data processing callback
+    bus->onRaw(cbRtuRaw); // Assign raw data processing callback, data for the wallbox communication is passed through
+
+    Serial.println(F("\nRunning in Modbus RTU<->TCP Gateway mode now...\n"));
 }
 
 
 void gateway_loop() {
-    // Run only when in gateway mode
-	if (cfgModbusGWActive == 1) {
-        rtu.task();
-        tcp.task();
-
-        if (lastSlave && (millis() - lastRequest > minRequestInterval * 1000)) {
-            rtu.rawRequest(lastSlave, (uint8_t*) "\x01\x00\x00\x00\x01", 5, cbRtuTrans);
-            lastRequest = millis();
+    // Run only when in gateway mode (1) or shared-bus mode (2)
+	if (cfgModbusGWActive == 1 || cfgModbusGWActive == 2) {
+        if (cfgModbusGWActive == 1) {
+            rtu.task();            // in shared-bus mode this is done by mb_loop()
         }
+        tcp.task();
+        dispatch();
+        poll();
 
         yield();
     }
-}
\ No newline at end of file
+}
+
+
+static void statJson(JsonObject obj, const gwStat_t* s, boolean withRtt) {
+  obj[F("req")]     = s->cnt[ST_REQ];
+  obj[F("cache")]   = s->cnt[ST_CACHE];
+  obj[F("busy")]    = s->cnt[ST_BUSY];
+  obj[F("sent")]    = s->cnt[ST_SENT];
+  obj[F("timeout")] = s->cnt[ST_TIMEOUT];
+  obj[F("dropped")] = s->cnt[ST_DROPPED];
+  obj[F("waitAvg")] = s->cnt[ST_SENT] ? s->cnt[ST_WAIT] / s->cnt[ST_SENT] : 0;
+  obj[F("waitMax")] = s->waitMax;
+  if (withRtt) {
+    JsonArray rtt = obj.createNestedArray(F("rtt"));
+    for (uint8_t b = 0; b < GW_HIST_CNT; b++) {
+      rtt.add(s->rtt[b]);
+    }
+  }
+}
+
+
+String gateway_getStatus() {
+  DynamicJsonDocument data(GW_JSON_LEN);
+  data[F("mode")]              = cfgModbusGWActive;
+  data[F("queue")][F("used")]  = queueCount(0);
+  data[F("queue")][F("size")]  = GW_QUEUE_SIZE;
+  data[F("inFlight")]          = __builtin_popcount(active) + (pollActive != -1 ? 1 : 0);
+  JsonArray limits = data.createNestedArray(F("rttLimits"));   // upper limits [ms] of the histogram buckets, last one is open
+  for (uint8_t b = 0; b < GW_HIST_CNT - 1; b++) {
+    limits.add(histLimit[b]);
+  }
+  statJson(data.createNestedObject(F("total")), &statTotal, true);
+
+  JsonArray units = data.createNestedArray(F("units"));
+  for (uint8_t i = 0; i < GW_STAT_UNITS && statUnit[i].used; i++) {
+    JsonObject u = units.createNestedObject();
+    u[F("unit")] = statUnit[i].key;
+    statJson(u, &statUnit[i], true);
+  }
+
+  JsonArray clients = data.createNestedArray(F("clients"));
+  for (uint8_t i = 0; i < GW_STAT_CLIENTS && statClient[i].used; i++) {
+    JsonObject c = clients.createNestedObject();
+    c[F("ip")] = IPAddress(statClient[i].key).toString();
+    statJson(c, &statClient[i], false);
+  }
+
+  JsonArray bg = data.createNestedArray(F("background"));
+  for (uint8_t i = 0; i < GW_POLL_CNT; i++) {
+    if (cfgGwPollUnit[i] != 0) {
+      JsonObject p = bg.createNestedObject();
+      p[F("unit")] = cfgGwPollUnit[i];
+      p[F("ok")]   = pollState[i].okCnt;
+      p[F("err")]  = pollState[i].errCnt;
+    }
+  }
+
+  String response;
+  serializeJson(data, response);
+  return(response);
+}
@@ -4,5 +4,6 @@
 
 extern void     gateway_setup();
 extern void     gateway_loop();
+extern String   gateway_getStatus();
 
 #endif /* GATEWAY_H */
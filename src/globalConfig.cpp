@@ -11,6 +11,12 @@ const uint8_t m = 5;
 #define WBEC_VER(s) "v" MAJOR_VER_STRING(s) ".4.9"     // token stringification
 #define MAJOR_VER_STRING(s) #s                         // .. with two levels of macros
 
+#define CFG_FILE_MAX 4096   // [byte] max. size of cfg.json
+#define CFG_KEY_MAX    96   // max. number of parameters in cfg.json, incl. reserve for new ones
+// worst case: all parameters and all arrays completely filled, the strings are added with the file size
+#define CFG_JSON_SIZE (JSON_OBJECT_SIZE(CFG_KEY_MAX) + JSON_ARRAY_SIZE(WB_CNT) + JSON_ARRAY_SIZE(LOG_MOD_CNT) + \
+                       3 * JSON_ARRAY_SIZE(GW_UNIT_CNT) + 5 * JSON_ARRAY_SIZE(GW_POLL_CNT))
+
 char     cfgWbecVersion[]             = WBEC_VER(WBEC_VERSION_MAJOR); // wbec version
 char     cfgBuildDate[]               = __DATE__ " " __TIME__;        // wbec build date
 
@@ -29,6 +35,12 @@ char     cfgMqttPass[32];             // MQTT: Password
 uint8_t  cfgMqttLp[WB_CNT];           // Array with assignments to openWB loadpoints, e.g. [4,2,0,1]: Box0 = LP4, Box1 = LP2, Box2 = no MQTT, Box3 = LP1
 char     cfgMqttWattTopic[60];        // MQTT: Topic for setting the watt value for PV charging, default: "wbec/pv/setWatt"
 char     cfgMqttWattJson[30];         // MQTT: Optional: Element in a JSON string, which contains the power in watt, default: ""
+uint8_t  cfgMqttMode;                 // MQTT: Bitmask: 1 = one topic per value, 2 = all values of a loadpoint as JSON in wbec/lp/N/state, 3 = both
+uint8_t  cfgMqttRefresh;              // MQTT: Interval [min] for publishing all topics, in between only changed values are published, 0 = always publish all topics
+uint16_t cfgMqttDeadband;             // MQTT: Min. change [W] of the power to be published, default: 0 = every change
+uint8_t  cfgMqttAck;                  // MQTT: Publish wbec/lp/N/ack with value and latency, when a new current limit is confirmed by the box: Active (1) or inactive (0)
+uint8_t  cfgMqttLog[LOG_MOD_CNT];     // MQTT: Log level per module for wbec/log: 0 = off, 1 = warnings, 2 = all
+uint8_t  cfgMqttSpill;                // MQTT: Max. size [kB] of the file for events during broker outages, when the RAM buffer is full, default: 0 = RAM only
 char     cfgNtpServer[30];            // NTP server
 char     cfgFoxUser[32];              // powerfox: Username
 char     cfgFoxPass[16];              // powerfox: Password
@@ -56,9 +68,22 @@ uint16_t cfgBootlogSize;              // Size of the bootlog buffer for debuggin
 uint16_t cfgBtnDebounce;              // Debounce time for button [ms]
 uint16_t cfgWifiConnectTimeout;       // Timeout in seconds to connect to Wifi before change to AP-Mode
 uint8_t  cfgResetOnTimeout;           // Set (some) Modbus values to 0 after 10x message timeout
-uint8_t  cfgModbusGWActive;           // General Modbus Gateway TCP<->RTU: Active (1) or inactive (0)
+uint8_t  cfgChargeLog;                // Record the charging sessions in /chargelog.bin: Active (1) or inactive (0)
+uint8_t  cfgModbusGWActive;           // General Modbus Gateway TCP<->RTU: Active (1), inactive (0) or shared with wallbox communication (2)
 uint32_t cfgRtu1BaudRate;             // baud rate for RS485 modbus rtu connector 1
 char     cfgRtu1Parity[3];            // Parity setting for RS485 modbus rtu connector 1, 8N1 or 8E1
+uint8_t  cfgMbServer;                 // Modbus TCP server (port 502) with the registers of the wallboxes, unit id = bus id: Active (1) or inactive (0)
+uint16_t cfgGwCacheTtl;               // Gateway: Time [ms] a read response is answered from cache, default: 0 = cache inactive
+uint8_t  cfgGwUnitId[GW_UNIT_CNT];    // Gateway: RTU units with individual settings, e.g. [33,1]
+uint16_t cfgGwUnitTtl[GW_UNIT_CNT];   // Gateway: Cache time [ms] for the units in cfgGwUnitId, e.g. [5000,500]
+uint8_t  cfgGwMaxBlock;               // Gateway: Max. registers when merging overlapping/adjacent reads, default: 0 = no merging
+uint8_t  cfgGwUnitBlock[GW_UNIT_CNT]; // Gateway: Max. registers for merged reads of the units in cfgGwUnitId, e.g. [32,16]
+uint8_t  cfgGwPollUnit[GW_POLL_CNT];  // Gateway: Background requests: unit, starts after the first TCP request to this unit, default: [33] (LG heat pump keepalive)
+uint8_t  cfgGwPollFc[GW_POLL_CNT];    // Gateway: Background requests: function code, e.g. [1]
+uint16_t cfgGwPollReg[GW_POLL_CNT];   // Gateway: Background requests: start address, e.g. [0]
+uint16_t cfgGwPollCnt[GW_POLL_CNT];   // Gateway: Background requests: number of registers/coils (or value for FC5/FC6), e.g. [1]
+uint16_t cfgGwPollTime[GW_POLL_CNT];  // Gateway: Background requests: interval [s], e.g. [60]
+uint16_t cfgGwPollJitter;             // Gateway: Background requests: random delay [ms] added to every interval
 
 static bool createConfig() {
 	StaticJsonDocument<128> doc;
@@ -78,36 +103,36 @@ static bool createConfig() {
 }
 
 
-static boolean checkConfig(JsonDocument& doc) {
+static File openConfig() {
 	File configFile = LittleFS.open(F("/cfg.json"), "r");
 	if (!configFile) {
-		LOG(m, "Failed to open config file... Creating default config...","")
+		LOGW(m, "Failed to open config file... Creating default config...","")
 		if (createConfig()) {
 			LOG(0, "Successful!", "");
 			configFile = LittleFS.open(F("/cfg.json"), "r");
 		} else {
-			LOG(m, "Failed to create default config... Please try to erase flash","");
-			return(false);
+			LOGW(m, "Failed to create default config... Please try to erase flash","");
 		}
 	}
+	return(configFile);
+}
 
-	size_t size = configFile.size();
-	if (size > 2048) {
-		LOG(m, "Config file size is too large","");
+
+static boolean checkConfig(JsonDocument& doc, File& configFile) {
+	if (!configFile) {
 		return(false);
 	}
 
-	// Allocate a buffer to store contents of the file.
-	std::unique_ptr<char[]> buf(new char[size]);
+	size_t size = configFile.size();
+	if (size > CFG_FILE_MAX) {
+		LOGW(m, "Config file size is too large: %u byte", size);
+		return(false);
+	}
 
-	// We don't use String here because ArduinoJson library requires the input
-	// buffer to be mutable. If you don't use ArduinoJson, you may as well
-	// use configFile.readString instead.
-	configFile.readBytes(buf.get(), size);
-	
-	auto error = deserializeJson(doc, buf.get());
+	// parsed directly from the file: the strings are copied into doc, no buffer for the whole file is needed
+	auto error = deserializeJson(doc, configFile);
 	if (error) {
-		LOG(m, "Failed to parse config file: %s", error.c_str());
+		LOGW(m, "Failed to parse config file: %s", error.c_str());
 		return(false);
 	}
 	configFile.close();
@@ -120,9 +145,10 @@ static boolean checkConfig(JsonDocument& doc) {
 
 
 void loadConfig() {
-	StaticJsonDocument<2048> doc;
-	if (!checkConfig(doc)) {
-		LOG(m, "Using default config", "");
+	File configFile = openConfig();
+	DynamicJsonDocument doc(CFG_JSON_SIZE + (configFile ? min(configFile.size(), (size_t)CFG_FILE_MAX) : 0));
+	if (!checkConfig(doc, configFile)) {
+		LOGW(m, "Using default config", "");
 		deserializeJson(doc, F("{}"));
 	}
 
@@ -140,6 +166,11 @@ void loadConfig() {
 	strncpy(cfgMqttPass,        doc["cfgMqttPass"]           | "",                 sizeof(cfgMqttPass));
 	strncpy(cfgMqttWattTopic,   doc["cfgMqttWattTopic"]      | "tinybox/pv/setWatt",  sizeof(cfgMqttWattTopic));
 	strncpy(cfgMqttWattJson,    doc["cfgMqttWattJson"]       | "",                 sizeof(cfgMqttWattJson));
+	cfgMqttMode               = doc["cfgMqttMode"]           | 1;
+	cfgMqttRefresh            = doc["cfgMqttRefresh"]        | 10;
+	cfgMqttDeadband           = doc["cfgMqttDeadband"]       | 0UL;
+	cfgMqttAck                = doc["cfgMqttAck"]            | 0;
+	cfgMqttSpill              = doc["cfgMqttSpill"]          | 0;
 	strncpy(cfgNtpServer,       doc["cfgNtpServer"]          | "europe.pool.ntp.org", sizeof(cfgNtpServer));
 	strncpy(cfgFoxUser,         doc["cfgFoxUser"]            | "",                 sizeof(cfgFoxUser));
 	strncpy(cfgFoxPass,         doc["cfgFoxPass"]            | "",                 sizeof(cfgFoxPass));
@@ -167,9 +198,14 @@ void loadConfig() {
 	cfgBtnDebounce            = doc["cfgBtnDebounce"]        | 0;
 	cfgWifiConnectTimeout     = doc["cfgWifiConnectTimeout"] | 10;
 	cfgResetOnTimeout         = doc["cfgResetOnTimeout"]     | 1;
+	cfgChargeLog              = doc["cfgChargeLog"]          | 0;
 	cfgModbusGWActive         = doc["cfgModbusGWActive"]     | 0;
 	cfgRtu1BaudRate           = doc["cfgRtu1BaudRate"]       | 19200;
 	strncpy(cfgRtu1Parity,      doc["cfgRtu1Parity"]         | "8E1",              sizeof(cfgRtu1Parity));
+	cfgMbServer               = doc["cfgMbServer"]           | 0;
+	cfgGwCacheTtl             = doc["cfgGwCacheTtl"]         | 0UL;
+	cfgGwMaxBlock             = doc["cfgGwMaxBlock"]         | 0;
+	cfgGwPollJitter           = doc["cfgGwPollJitter"]       | 0UL;
 	
 	
 	LOG(m, "cfgWbecVersion: %s", cfgWbecVersion);
@@ -182,8 +218,33 @@ void loadConfig() {
 		} else {
 			cfgMqttLp[i]            = 0;
 		}
-		if (cfgMqttLp[i] > OPENWB_MAX_LP) {
+		if (cfgMqttLp[i] > MQTT_MAX_LP) {
 			cfgMqttLp[i]            = 0;
 		}
 	}
+
+	// default: webserver, go-e and websocket are too chatty for MQTT, modbus and MQTT only warnings
+	const uint8_t mqttLogDefault[LOG_MOD_CNT] = {2, 1, 1, 0, 0, 2, 2, 2, 2, 1, 0, 2, 1, 1};
+	for (uint8_t i = 0; i < LOG_MOD_CNT; i++) {
+		cfgMqttLog[i]             = doc["cfgMqttLog"][i]         | mqttLogDefault[i];
+	}
+
+	for (uint8_t i = 0; i < GW_UNIT_CNT; i++) {
+		cfgGwUnitId[i]            = doc["cfgGwUnitId"][i]        | 0;
+		cfgGwUnitTtl[i]           = doc["cfgGwUnitTtl"][i]       | cfgGwCacheTtl;
+		cfgGwUnitBlock[i]         = doc["cfgGwUnitBlock"][i]     | cfgGwMaxBlock;
+	}
+
+	for (uint8_t i = 0; i < GW_POLL_CNT; i++) {
+		cfgGwPollUnit[i]          = doc["cfgGwPollUnit"][i]      | 0;
+		cfgGwPollFc[i]            = doc["cfgGwPollFc"][i]        | 3;
+		cfgGwPollReg[i]           = doc["cfgGwPollReg"][i]       | 0;
+		cfgGwPollCnt[i]           = doc["cfgGwPollCnt"][i]       | 1;
+		cfgGwPollTime[i]          = doc["cfgGwPollTime"][i]      | 60;
+	}
+	if (doc["cfgGwPollUnit"].isNull()) {
+		// default: keepalive for LG heat pump (always has modbus address 33), read coil 0 every 60s
+		cfgGwPollUnit[0]          = 33;
+		cfgGwPollFc[0]            = 1;
+	}
 }
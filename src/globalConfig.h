@@ -4,7 +4,10 @@
 #define GLOBALCONFIG_H
 
 #define WB_CNT             16   // max. possible number of wallboxes in the system (NodeMCU has Bus-ID = 0)
-#define OPENWB_MAX_LP       8   // maximum supported loadpoints by openWB
+#define MQTT_MAX_LP        32   // maximum loadpoint number, which can be assigned in cfgMqttLp
+#define GW_UNIT_CNT         8   // max. number of RTU units with individual gateway settings
+#define GW_POLL_CNT         8   // max. number of gateway background requests
+#define LOG_MOD_CNT        14   // number of modules of the logger
 #define REG_WD_TIME_OUT   257   // modbus register for "ModBus-Master Watchdog Timeout in ms"
 #define REG_STANDBY_CTRL  258   // modbus register for "Standby Function Control"
 #define REG_REMOTE_LOCK   259   // modbus register for "Remote lock (only if extern lock unlocked)"
@@ -43,6 +46,12 @@ extern char     cfgMqttPass[32];             // MQTT: Password
 extern uint8_t  cfgMqttLp[WB_CNT];           // Array with assignments to openWB loadpoints, e.g. [4,2,0,1]: Box0 = LP4, Box1 = LP2, Box2 = no MQTT, Box3 = LP1
 extern char     cfgMqttWattTopic[60];        // MQTT: Topic for setting the watt value for PV charging, default: "wbec/pv/setWatt"
 extern char     cfgMqttWattJson[30];         // MQTT: Optional: Element in a JSON string, which contains the power in watt, default: ""
+extern uint8_t  cfgMqttMode;                 // MQTT: Bitmask: 1 = one topic per value, 2 = all values of a loadpoint as JSON in wbec/lp/N/state, 3 = both
+extern uint8_t  cfgMqttRefresh;              // MQTT: Interval [min] for publishing all topics, in between only changed values are published, 0 = always publish all topics
+extern uint16_t cfgMqttDeadband;             // MQTT: Min. change [W] of the power to be published, default: 0 = every change
+extern uint8_t  cfgMqttAck;                  // MQTT: Publish wbec/lp/N/ack with value and latency, when a new current limit is confirmed by the box: Active (1) or inactive (0)
+extern uint8_t  cfgMqttLog[LOG_MOD_CNT];     // MQTT: Log level per module for wbec/log: 0 = off, 1 = warnings, 2 = all
+extern uint8_t  cfgMqttSpill;                // MQTT: Max. size [kB] of the file for events during broker outages, when the RAM buffer is full, default: 0 = RAM only
 extern char     cfgNtpServer[30];            // NTP server
 extern char     cfgFoxUser[32];              // powerfox: Username
 extern char     cfgFoxPass[16];              // powerfox: Password
@@ -70,9 +79,22 @@ extern uint16_t cfgBootlogSize;              // Size of the bootlog buffer for d
 extern uint16_t cfgBtnDebounce;              // Debounce time for button [ms]
 extern uint16_t cfgWifiConnectTimeout;       // Timeout in seconds to connect to Wifi before change to AP-Mode
 extern uint8_t  cfgResetOnTimeout;           // Set (some) Modbus values to 0 after 10x message timeout
-extern uint8_t  cfgModbusGWActive;           // General Modbus Gateway TCP<->RTU: Active (1) or inactive (0)
+extern uint8_t  cfgChargeLog;                // Record the charging sessions in /chargelog.bin: Active (1) or inactive (0)
+extern uint8_t  cfgModbusGWActive;           // General Modbus Gateway TCP<->RTU: Active (1), inactive (0) or shared with wallbox communication (2)
 extern uint32_t cfgRtu1BaudRate;             // baud rate for RS485 modbus rtu connector 1
 extern char     cfgRtu1Parity[3];            // Parity setting for RS485 modbus rtu connector 1, 8N1 or 8E1
+extern uint8_t  cfgMbServer;                 // Modbus TCP server (port 502) with the registers of the wallboxes, unit id = bus id: Active (1) or inactive (0)
+extern uint16_t cfgGwCacheTtl;               // Gateway: Time [ms] a read response is answered from cache, default: 0 = cache inactive
+extern uint8_t  cfgGwUnitId[GW_UNIT_CNT];    // Gateway: RTU units with individual settings, e.g. [33,1]
+extern uint16_t cfgGwUnitTtl[GW_UNIT_CNT];   // Gateway: Cache time [ms] for the units in cfgGwUnitId, e.g. [5000,500]
+extern uint8_t  cfgGwMaxBlock;               // Gateway: Max. registers when merging overlapping/adjacent reads, default: 0 = no merging
+extern uint8_t  cfgGwUnitBlock[GW_UNIT_CNT]; // Gateway: Max. registers for merged reads of the units in cfgGwUnitId, e.g. [32,16]
+extern uint8_t  cfgGwPollUnit[GW_POLL_CNT];  // Gateway: Background requests: unit, starts after the first TCP request to this unit, default: [33] (LG heat pump keepalive)
+extern uint8_t  cfgGwPollFc[GW_POLL_CNT];    // Gateway: Background requests: function code, e.g. [1]
+extern uint16_t cfgGwPollReg[GW_POLL_CNT];   // Gateway: Background requests: start address, e.g. [0]
+extern uint16_t cfgGwPollCnt[GW_POLL_CNT];   // Gateway: Background requests: number of registers/coils (or value for FC5/FC6), e.g. [1]
+extern uint16_t cfgGwPollTime[GW_POLL_CNT];  // Gateway: Background requests: interval [s], e.g. [60]
+extern uint16_t cfgGwPollJitter;             // Gateway: Background requests: random delay [ms] added to every interval
 
 
 extern void loadConfig();
@@ -77,12 +77,12 @@ void goE_setPayload(String payload, uint8_t id) {
 		if (val == 1) {
 			// charging allowed
 			box[id].alw = 1;
-			lm_storeRequest(id, box[id].amp);
+			lm_storeRequest(id, box[id].amp, LM_SRC_GOE);
 		} 
 		if (val == 0) {
 			// charging  not allowed
 			box[id].alw = 0;
-			lm_storeRequest(id, 0);
+			lm_storeRequest(id, 0, LM_SRC_GOE);
 		}
 	}
 	if (cmd == F("amp") || cmd == F("amx")) {
@@ -91,7 +91,7 @@ void goE_setPayload(String payload, uint8_t id) {
 		// set current
 		if (val >= CURR_ABS_MIN && val <= CURR_ABS_MAX) {	// values are between 6..32A according to API, 0 is not allowed
 			box[id].amp = val;
-			lm_storeRequest(id, box[id].amp);
+			lm_storeRequest(id, box[id].amp, LM_SRC_GOE);
 		}
 	}
 	if (cmd == F("dwo")) {
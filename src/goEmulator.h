@@ -4,6 +4,7 @@
 #define GOEMULATOR_H
 
 extern void 		goE_handle();
+extern boolean  goE_plugged(uint16_t chgStat);
 extern void     goE_setPayload(String payload, uint8_t id);
 extern String		goE_getStatus(uint8_t id, boolean fromApp);
 extern uint32_t goE_getEnergySincePlugged(uint8_t id); 
@@ -107,13 +107,13 @@ static void timeout(uint8_t id) {
 static bool cbWrite(Modbus::ResultCode event, uint16_t transactionId, void* data) {
 	modbusResultCode = event;
 	if (event) {
-		LOG(m, "RTU2: Comm-Failure BusID %d", mbrtu2.slave());
+		LOGW(m, "RTU2: Comm-Failure BusID %d", mbrtu2.slave());
 		if (modbusFailureCnt < 250) {
 			modbusFailureCnt++;
 		}
 		if (modbusFailureCnt == 10) {
 			// too many consecutive timeouts --> reset values
-			LOG(m, "RTU2: Timeout BusID %d", mbrtu2.slave());
+			LOGW(m, "RTU2: Timeout BusID %d", mbrtu2.slave());
 			timeout(id);
 		}
 	} else {
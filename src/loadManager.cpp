@@ -6,6 +6,7 @@
 #include "mbComm.h"
 
 #define CYCLE_TIME		             500	// ms
+#define LM_ACK_TIMEOUT           60000	// ms, requests which are not confirmed within this time are counted as timeout
 
 
 static uint32_t lastCall           = 0;
@@ -13,6 +14,24 @@ static uint32_t lastCall           = 0;
 static uint8_t  currLim[WB_CNT];
 static uint8_t  lastReq[WB_CNT];
 
+typedef struct lmPending_struct {
+	boolean  active;       // request waits for the confirmation by the box
+	uint8_t  val;
+	uint8_t  src;
+	uint32_t rcvTime;      // millis() when the request was received
+} lmPending_t;
+
+typedef struct lmAck_struct {
+	uint16_t seq;          // incremented with every confirmation
+	uint8_t  val;
+	uint8_t  src;
+	uint32_t latency;      // [ms]
+} lmAck_t;
+
+static lmPending_t pending[WB_CNT];
+static lmAck_t     ack[WB_CNT];
+static lmLatency_t latency[LM_SRC_CNT];
+
 /*
 static uint16_t sumRead            = 0;
 static uint16_t sumReq             = 0;
@@ -198,12 +217,24 @@ void lm_setup() {
 
 
 void lm_loop() {
-	if ((millis() - lastCall < CYCLE_TIME) || (cfgTotalCurrMax == 0) || (cfgCntWb != 2)) {
+	if (millis() - lastCall < CYCLE_TIME) {
 		// avoid unnecessary frequent calls
 		return;
 	}
 	lastCall = millis();
 
+	// requests, which were never confirmed
+	for (uint8_t id = 0; id < cfgCntWb ; id++) {
+		if (pending[id].active && millis() - pending[id].rcvTime > LM_ACK_TIMEOUT) {
+			pending[id].active = false;
+			latency[pending[id].src].timeout++;
+		}
+	}
+
+	if ((cfgTotalCurrMax == 0) || (cfgCntWb != 2)) {
+		return;
+	}
+
 	/*
 	// load management only starts when all boxes have been received once
 	if (allBoxesReceived == false) {
@@ -235,8 +266,20 @@ uint8_t lm_getLastRequest(uint8_t id) {
 }
 
 
-void lm_storeRequest(uint8_t id, uint8_t val) {
+void lm_storeRequest(uint8_t id, uint8_t val, uint8_t src /* =LM_SRC_INTERNAL */) {
 	lastReq[id] = val;
+	// remember the request to measure the time until the box confirms it (repeated requests keep the first timestamp)
+	boolean repeated = pending[id].active && pending[id].val == val;
+	boolean applied  = !pending[id].active && content[id][53] == val;   // box has already this value
+	if (!repeated && !applied) {
+		if (pending[id].active) {
+			latency[pending[id].src].timeout++;   // superseded before confirmation
+		}
+		pending[id].active  = true;
+		pending[id].val     = val;
+		pending[id].src     = src;
+		pending[id].rcvTime = millis();
+	}
 	// when there is still buffer OR request is lowered OR load management inactive
 	if (/*(sumRead + val < cfgTotalCurrMax) ||*/ (val < content[id][53]) || (cfgTotalCurrMax == 0)) {
 		// direct write is possible
@@ -246,8 +289,37 @@ void lm_storeRequest(uint8_t id, uint8_t val) {
 
 
 void lm_currentReadSuccess(uint8_t id) {
+	// the current limit was read from the box: check if it confirms the pending request
+	if (pending[id].active && content[id][53] == pending[id].val) {
+		uint32_t t = millis() - pending[id].rcvTime;
+		lmLatency_t* l = &latency[pending[id].src];
+		if (l->cnt == 0 || t < l->min) { l->min = t; }
+		if (t > l->max)                { l->max = t; }
+		l->cnt++;
+		l->sum += t;
+		pending[id].active = false;
+		ack[id].seq++;
+		ack[id].val     = pending[id].val;
+		ack[id].src     = pending[id].src;
+		ack[id].latency = t;
+	}
+
 	// takeover the value from wallbox as long as not all boxes are received
 	//if (allBoxesReceived == false) {
 	//	currLim[id] = content[id][53];
 	//} // else do nothing
 }
+
+
+const lmLatency_t* lm_getLatency(uint8_t src) {
+	return(&latency[src]);
+}
+
+
+uint16_t lm_getAck(uint8_t id, uint8_t *val, uint32_t *lat, uint8_t *src) {
+	// last confirmed request of the box, the sequence number shows if it's a new one
+	*val = ack[id].val;
+	*lat = ack[id].latency;
+	*src = ack[id].src;
+	return(ack[id].seq);
+}
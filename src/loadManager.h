@@ -1,12 +1,33 @@
 #ifndef LOADMANAGER_H
 #define LOADMANAGER_H
 
+typedef enum {
+	LM_SRC_INTERNAL = 0,   // pv, rfid, button, phase control, ...
+	LM_SRC_OPENWB   = 1,   // MQTT openWB/lp/N/AConfigured
+	LM_SRC_OPENWB2  = 2,   // MQTT openWB/chargepoint/N/set/current
+	LM_SRC_EVCC     = 3,   // MQTT wbec/lp/N/maxcurrent, .../enable
+	LM_SRC_WEB      = 4,   // web server, websocket
+	LM_SRC_GOE      = 5,   // go-e emulation
+	LM_SRC_MBTCP    = 6,   // Modbus TCP server
+	LM_SRC_CNT      = 7
+} lmSource_t;
+
+typedef struct lmLatency_struct {
+	uint16_t cnt;          // requests confirmed by the read back of the box
+	uint16_t timeout;      // requests not confirmed within LM_ACK_TIMEOUT (or superseded)
+	uint32_t sum;          // [ms] sum of the latencies (from request to confirmation)
+	uint32_t min;          // [ms]
+	uint32_t max;          // [ms]
+} lmLatency_t;
+
 extern void     lm_setup();
 extern void     lm_loop();
 
 extern uint8_t 	lm_getWbLimit(uint8_t id);
 extern uint8_t 	lm_getLastRequest(uint8_t id);
-extern void     lm_storeRequest(uint8_t id, uint8_t val);
+extern void     lm_storeRequest(uint8_t id, uint8_t val, uint8_t src=LM_SRC_INTERNAL);
 extern void 		lm_currentReadSuccess(uint8_t id);
+extern const lmLatency_t* lm_getLatency(uint8_t src);
+extern uint16_t lm_getAck(uint8_t id, uint8_t *val, uint32_t *latency, uint8_t *src);
 
 #endif /* LOADMANAGER_H */
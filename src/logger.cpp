@@ -18,7 +18,7 @@
 static WiFiUDP ntpUDP;
 static NTPClient timeClient(ntpUDP, cfgNtpServer, 3600, 60000); // GMT+1 and update every minute
 
-static const char *mod[13] = {"", "MB  ", "MQTT", "WEBS", "GO-E", "CFG ", "1P3P", "LLOG", "RFID", "PFOX", "SOCK", "PV  ", "SHLY"};
+static const char *mod[LOG_MOD_CNT] = {"", "MB  ", "MQTT", "WEBS", "GO-E", "CFG ", "1P3P", "LLOG", "RFID", "PFOX", "SOCK", "PV  ", "SHLY", "MBS "};
 static char *   bootLog;
 static uint16_t bootLogSize;
 
@@ -83,7 +83,7 @@ static boolean getDstGermany(uint32_t unixtime) {
 }
 
 
-void log(uint8_t module, String msg, boolean newLine /* =true */) {
+void log(uint8_t module, String msg, boolean newLine /* =true */, uint8_t level /* =LOG_INFO */) {
 	String output;
 
   if (module) {
@@ -98,11 +98,11 @@ void log(uint8_t module, String msg, boolean newLine /* =true */) {
   if ((strlen(bootLog)+strlen(output.c_str()) + 5) < bootLogSize) {
     strcat(bootLog, output.c_str());
   } 
-  mqtt_log(output.c_str(), msg.c_str());
+  mqtt_log(module, level, output.c_str(), msg.c_str(), newLine);
 }
 
 
-void log(uint8_t module, const char *msg, boolean newLine /* =true */) {
+void log(uint8_t module, const char *msg, boolean newLine /* =true */, uint8_t level /* =LOG_INFO */) {
 	char output[TIME_LEN + MOD_LEN + 1];
 
   if (module) {
@@ -127,7 +127,7 @@ void log(uint8_t module, const char *msg, boolean newLine /* =true */) {
       strcat(bootLog, "\n");
 	  }
   }
-  mqtt_log(output, msg);
+  mqtt_log(module, level, output, msg, newLine);
 }
 
 
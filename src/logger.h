@@ -3,10 +3,15 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#define LOG_WARN   1    // log levels, see cfgMqttLog
+#define LOG_INFO   2
+
 // standard log
 #define LOG(MODULE, TEXT, ...)    {char s[100]; snprintf_P(s, sizeof(s), PSTR(TEXT), __VA_ARGS__); log(MODULE, s);}
 // standard log without newline
 #define LOGN(MODULE, TEXT, ...)   {char s[100]; snprintf_P(s, sizeof(s), PSTR(TEXT), __VA_ARGS__); log(MODULE, s, false);}
+// warning
+#define LOGW(MODULE, TEXT, ...)   {char s[100]; snprintf_P(s, sizeof(s), PSTR(TEXT), __VA_ARGS__); log(MODULE, s, true, LOG_WARN);}
 // large log
 #define LOGEXT(MODULE, TEXT, ...) {char s[600]; snprintf_P(s, sizeof(s), PSTR(TEXT), __VA_ARGS__); log(MODULE, s);};
 
@@ -14,8 +19,8 @@ extern void logger_allocate();
 extern void logger_setup();
 extern void logger_loop();
 
-extern void     log(uint8_t module, String msg,      boolean newLine=true);
-extern void     log(uint8_t module, const char *msg, boolean newLine=true);
+extern void     log(uint8_t module, String msg,      boolean newLine=true, uint8_t level=LOG_INFO);
+extern void     log(uint8_t module, const char *msg, boolean newLine=true, uint8_t level=LOG_INFO);
 extern String   log_time();
 extern uint32_t log_unixTime();
 
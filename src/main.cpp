@@ -3,6 +3,7 @@
 #include <Arduino.h>
 #include <ArduinoOTA.h>
 #include "button.h"
+#include "chargeLog.h"
 #include "globalConfig.h"
 #include "goEmulator.h"
 #include "inverter.h"
@@ -11,9 +12,11 @@
 #include "loadManager.h"
 #include "logger.h"
 #include "mbComm.h"
+#include "mbServer.h"
 #include "mqtt.h"
 #include "phaseCtrl.h"
 #include "pvAlgo.h"
+#include "pvLog.h"
 #include "shelly.h"
 #define WIFI_MANAGER_USE_ASYNC_WEB_SERVER
 #include "WiFiManager.h"
@@ -67,6 +70,7 @@ void setup() {
 
   ArduinoOTA.onStart([]()
   {
+    pvLog_flush(true);   // the loop isn't called anymore during the update
     _handlingOTA = true;
   });
 
@@ -75,9 +79,12 @@ void setup() {
   shelly_setup();
   inverter_setup();
   gateway_setup();
+  mbs_setup();
   btn_setup();
+  pvLog_setup();
   pv_setup();
   lm_setup();
+  chargeLog_setup();
   Serial.print(F("Boot time: ")); Serial.println(millis());
   Serial.print(F("Free heap: ")); Serial.println(ESP.getFreeHeap());
 }
@@ -89,14 +96,17 @@ void loop() {
     logger_loop();
     mb_loop();
     goE_handle();
+    chargeLog_loop();
     mqtt_handle();
     webServer_loop();
     webSocket_loop();
     shelly_loop();
     inverter_loop();
     gateway_loop();
+    mbs_loop();
     btn_loop();
     pv_loop();
+    pvLog_loop();
     pc_handle();
     lm_loop();
     if (cfgLoopDelay <= 50) {          // see #18, might have an effect to reactivity of webserver in some environments
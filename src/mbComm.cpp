@@ -4,7 +4,6 @@
 #include "globalConfig.h"
 #include "logger.h"
 #include "mbComm.h"
-#include "mqtt.h"
 #include <ModbusRTU.h>
 #include "loadManager.h"
 #include "phaseCtrl.h"
@@ -33,10 +32,19 @@ static uint32_t  modbusLastMsgSentTime = 0;
 static uint8_t   modbusFailureCnt[WB_CNT];
 static uint8_t   msgCnt = 0;
 static uint8_t   id = 0;
-static uint8_t   msgCnt0_lastId = 255;
 static rb_t      rb[RINGBUF_SIZE];    // ring buffer
 static uint8_t   rbIn  = 0;           // last element, which was written to ring buffer
 static uint8_t   rbOut = 0;           // last element, which was read from ring buffer
+static mbBus_t   busClass = MB_BUS_WB_POLL;  // traffic class of the current transaction on the bus
+static int8_t    busCurrRead = -1;           // box, whose current limit (REG_CURR_LIMIT) is read by the current transaction, -1 = none
+static boolean   busBaseRead = false;        // current transaction is the first poll message (input registers 4..18)
+static uint32_t  busTime[MB_BUS_CNT];        // [ms] time the bus was occupied, per traffic class
+static uint32_t  busLastSample = 0;
+static uint32_t  stateSum[WB_CNT];           // checksum of content[] and result code, per box
+static uint32_t  stateVer[WB_CNT];           // incremented, when the checksum of the box changed
+static uint32_t  stateVerAll = 0;            // incremented, when any box changed
+static uint8_t   stateId = 0;                // box, whose checksum is checked next
+static boolean   stateValid[WB_CNT];         // true, when the input registers of the box were read at least once
 
 static boolean mb_available() {
 	// don't allow new msg, when communication is still active (ca.30ms) or minimum delay time not exceeded
@@ -77,23 +85,28 @@ static bool cbWrite(Modbus::ResultCode event, uint16_t transactionId, void* data
 	int id = mb.slave()-1;
 	modbusResultCode[id] = event;
 	if (event) {
-		LOG(m, "RTU1 Comm-Failure BusID %d", mb.slave());
+		LOGW(m, "RTU1 Comm-Failure BusID %d", mb.slave());
 		if (modbusFailureCnt[id] < 250) {
 			modbusFailureCnt[id]++;
 		}
 		if (modbusFailureCnt[id] == 10) {
 			// too many consecutive timeouts --> reset values
-			LOG(m, "RTU1 Timeout BusID %d", mb.slave());
+			LOGW(m, "RTU1 Timeout BusID %d", mb.slave());
 			timeout(id);
 		}
 	} else {
 		// no failure
 		modbusFailureCnt[id] = 0;
-		// tell load manager that the current register was successfully read
-		if (msgCnt == 6+1) {
+		// tell load manager that the current register was successfully read (cyclic or read back after write)
+		if (busCurrRead == id) {
 			lm_currentReadSuccess(id);
 		}
+		if (busBaseRead) {
+			stateValid[id] = true;
+		}
 	}
+	busCurrRead = -1;
+	busBaseRead = false;
 	
 	//log(m, "RTU1 ResultCode: 0x" + String(event, HEX) + ", BusID: "+ mb.slave());
 	return(true);
@@ -101,8 +114,8 @@ static bool cbWrite(Modbus::ResultCode event, uint16_t transactionId, void* data
 
 
 void mb_setup() {
-	// Setup only when NOT in gateway mode
-	if (cfgModbusGWActive == 0) {
+	// Setup only when NOT in (exclusive) gateway mode
+	if (cfgModbusGWActive != 1) {
 		// setup SoftwareSerial and Modbus Master
 		LOG(m, "HwVersion: %d", cfgHwVersion);
 		if (cfgHwVersion == 10) {
@@ -121,12 +134,15 @@ void mb_setup() {
 
 
 void mb_loop() {
-	// Run only when NOT in gateway mode
-	if (cfgModbusGWActive == 0) {
+	// Run only when NOT in (exclusive) gateway mode
+	if (cfgModbusGWActive != 1) {
 		// When pointers of the ring buffer are not equal, then there is something to send
 		if (rbOut != rbIn) {
 			if (mb_available()) {			// check, if bus available
 				rbOut = (rbOut+1) % RINGBUF_SIZE; 		// increment pointer, but take care of overflow
+				busClass = MB_BUS_WB_WRITE;
+				busCurrRead = (rb[rbOut].buf == &content[rb[rbOut].id][53]) ? rb[rbOut].id : -1;
+				busBaseRead = false;
 				if (rb[rbOut].buf != NULL) {
 					mb.readHreg (rb[rbOut].id + 1, rb[rbOut].reg,  rb[rbOut].buf, 1, cbWrite);
 				} else {
@@ -139,16 +155,14 @@ void mb_loop() {
 		if (modbusLastTime == 0 || millis() - modbusLastTime > (cfgMbCycleTime*1000)) {
 			if (mb_available()) {
 				//Serial.print(millis());Serial.print(": Sending to BusID: ");Serial.print(id+1);Serial.print(" with msgCnt = ");Serial.println(msgCnt);
-				if (msgCnt0_lastId != 255) {
-					// msgCnt=0 was recently sent => content is updated => publish to MQTT
-					mqtt_publish(msgCnt0_lastId);
-					msgCnt0_lastId = 255;
-				}
 				if (!modbusResultCode[id]) {
 					//log(m, String(millis()) + ": BusID=" + (id+1) + ",msgCnt=" + msgCnt);
 				}
+				busClass = MB_BUS_WB_POLL;
+				busCurrRead = (msgCnt == 6) ? id : -1;
+				busBaseRead = (msgCnt == 0);
 				switch(msgCnt) {
-					case 0:                                                       mb.readIreg (id+1,   4,              &content[id][0] ,  15, cbWrite); msgCnt0_lastId = id; break;
+					case 0:                                                       mb.readIreg (id+1,   4,              &content[id][0] ,  15, cbWrite); break;
 					case 1: if (!modbusResultCode[id])                          { mb.readIreg (id+1, 100,              &content[id][15],  17, cbWrite); } break;
 					case 2: if (!modbusResultCode[id])                          { mb.readIreg (id+1, 117,              &content[id][32],  17, cbWrite); } break;
 					case 3: if (!modbusResultCode[id])                          { mb.readHreg (id+1, REG_WD_TIME_OUT,  &content[id][49],   1, cbWrite); } break;
@@ -174,7 +188,26 @@ void mb_loop() {
 				}
 			}
 		}
+		// measure the bus occupancy (callbacks are called within task())
+		if (mb.slave()) {
+			busTime[busClass] += millis() - busLastSample;
+		}
+		busLastSample = millis();
 		mb.task();
+		// one box per loop: update the state version, when the content has changed (triggers MQTT, web clients, ...)
+		if (stateId >= cfgCntWb) {
+			stateId = 0;
+		}
+		uint32_t sum = modbusResultCode[stateId];
+		for (uint8_t i = 0; i < 55; i++) {
+			sum = sum * 31 + content[stateId][i];
+		}
+		if (sum != stateSum[stateId]) {
+			stateSum[stateId] = sum;
+			stateVer[stateId]++;
+			stateVerAll++;
+		}
+		stateId++;
 		yield();
 	}
 }
@@ -194,7 +227,7 @@ void mb_writeReg(uint8_t id, uint16_t reg, uint16_t val) {
 	if (rbIn == rbOut) {
 		// we have overwritten an not-sent value -> set rbOut to next element, otherwise complete ring would be skipped
 		rbOut = (rbOut+1) % RINGBUF_SIZE; 		// increment pointer, but take care of overflow
-		LOG(m, "Overflow of ring buffer", "");
+		LOGW(m, "Overflow of ring buffer", "");
 	}
 
 	// direct read back, when current register was modified
@@ -211,3 +244,45 @@ void mb_writeReg(uint8_t id, uint16_t reg, uint16_t val) {
 uint8_t mb_getFailureCnt(uint8_t id) {
 	return(modbusFailureCnt[id]);
 }
+
+
+ModbusRTU* mb_getBus() {
+	return(&mb);
+}
+
+
+boolean mb_busFree() {
+	// In shared-bus mode other frames are interleaved with the wallbox poll: no frame in flight, no write pending
+	// and the same delay after the last frame as for the wallbox messages
+	if (cfgModbusGWActive != 2) {
+		return(true);
+	}
+	return(!mb.slave() && rbOut == rbIn && millis() - modbusLastMsgSentTime >= cfgMbDelay);
+}
+
+
+void mb_busAcquire(mbBus_t cls) {
+	// called by other users of the bus, when a request was sent
+	busClass = cls;
+	modbusLastMsgSentTime = millis();
+}
+
+
+uint32_t mb_busTime(mbBus_t cls) {
+	return(busTime[cls]);
+}
+
+
+uint32_t mb_getVersion(uint8_t id) {
+	return(stateVer[id]);
+}
+
+
+boolean mb_isValid(uint8_t id) {
+	return(stateValid[id]);
+}
+
+
+uint32_t mb_getVersionAll() {
+	return(stateVerAll);
+}
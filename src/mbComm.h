@@ -1,15 +1,31 @@
 // Copyright (c) 2021 steff393
 
 #include "globalConfig.h"
+#include <ModbusRTU.h>
 
 #ifndef MBCOMM_H
 #define MBCOMM_H
 
+typedef enum {
+	MB_BUS_WB_POLL       = 0,   // cyclic reading of the wallboxes
+	MB_BUS_WB_WRITE      = 1,   // writes to the wallboxes (e.g. current limit) incl. read back
+	MB_BUS_GW_LIVE       = 2,   // gateway: requests from Modbus TCP clients
+	MB_BUS_GW_BACKGROUND = 3,   // gateway: background requests
+	MB_BUS_CNT           = 4
+} mbBus_t;
+
 extern void      mb_setup();
 extern void      mb_loop();
 extern void      mb_writeReg(uint8_t id, uint16_t reg, uint16_t val);
 extern void      mb_getAscii(uint8_t id, uint8_t from, uint8_t len, char *result);
 extern uint8_t   mb_getFailureCnt(uint8_t id);
+extern ModbusRTU* mb_getBus();
+extern boolean   mb_busFree();
+extern void      mb_busAcquire(mbBus_t cls);
+extern uint32_t  mb_busTime(mbBus_t cls);
+extern uint32_t  mb_getVersion(uint8_t id);
+extern boolean   mb_isValid(uint8_t id);
+extern uint32_t  mb_getVersionAll();
 
 extern uint16_t  content[WB_CNT][55];
 extern uint32_t  modbusLastTime;
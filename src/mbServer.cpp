@@ -0,0 +1,135 @@
+// Copyright (c) 2023 steff393, MIT license
+// Modbus TCP server, which provides the registers of the wallboxes from RAM (no RS485 traffic)
+
+#include <Arduino.h>
+#ifdef ESP32
+#include <WiFi.h>
+#else
+#include <ESP8266WiFi.h>
+#endif
+#include "globalConfig.h"
+#include "loadManager.h"
+#include "logger.h"
+#include "mbComm.h"
+#include "mbServer.h"
+
+static const uint8_t m = 13;
+
+static ModbusTCP mbs;
+static bool      mbsActive = false;
+
+
+static int8_t regIndex(uint8_t fc, uint16_t reg) {
+	// map the register of the wallbox to the index in content[][], see mb_loop()
+	if (fc == Modbus::FC_READ_INPUT_REGS) {
+		if (reg >=   4 && reg <=  18) { return(reg -   4);      }
+		if (reg >= 100 && reg <= 133) { return(reg - 100 + 15); }
+	} else {
+		if (reg >= REG_WD_TIME_OUT && reg <= REG_REMOTE_LOCK)   { return(reg - REG_WD_TIME_OUT + 49); }
+		if (reg >= REG_CURR_LIMIT  && reg <= REG_CURR_LIMIT_FS) { return(reg - REG_CURR_LIMIT  + 53); }   // 260 isn't read by mb_loop()
+	}
+	return(-1);
+}
+
+
+static uint16_t getWord(const uint8_t *data) {
+	return((uint16_t)data[0] << 8 | data[1]);
+}
+
+
+static Modbus::ResultCode error(ModbusTCP *tcp, Modbus::frame_arg_t *src, uint8_t fc, Modbus::ResultCode code) {
+	tcp->setTransactionId(src->transactionId); // Set transaction id as per incoming request
+	tcp->errorResponce(IPAddress(src->ipaddr), (Modbus::FunctionCode)fc, code);
+	return(code);
+}
+
+
+Modbus::ResultCode mbs_request(ModbusTCP *tcp, uint8_t *data, uint8_t len, Modbus::frame_arg_t *src) {
+	// Unit id = bus id of the wallbox, other units are not handled here
+	if (!cfgMbServer || cfgModbusGWActive == 1 || src->unitId == 0 || src->unitId > cfgCntWb) {
+		return(Modbus::EX_PASSTHROUGH);
+	}
+	uint8_t id = src->unitId - 1;
+	uint8_t fc = data[0];
+	uint8_t resp[2 + 2 * 34];       // max. 34 consecutive registers (100..133)
+
+	switch (fc) {
+		case Modbus::FC_READ_REGS:
+		case Modbus::FC_READ_INPUT_REGS: {
+			if (len != 5) {
+				return(error(tcp, src, fc, Modbus::EX_ILLEGAL_VALUE));
+			}
+			uint16_t reg = getWord(&data[1]);
+			uint16_t cnt = getWord(&data[3]);
+			if (cnt == 0 || cnt > (sizeof(resp) - 2) / 2) {
+				return(error(tcp, src, fc, Modbus::EX_ILLEGAL_VALUE));
+			}
+			resp[0] = fc;
+			resp[1] = cnt * 2;
+			for (uint16_t i = 0; i < cnt; i++) {
+				int8_t idx = regIndex(fc, reg + i);
+				if (idx < 0) {
+					return(error(tcp, src, fc, Modbus::EX_ILLEGAL_ADDRESS));
+				}
+				resp[2 + i * 2]     = content[id][idx] >> 8;
+				resp[2 + i * 2 + 1] = content[id][idx] & 0xFF;
+			}
+			tcp->setTransactionId(src->transactionId);
+			tcp->rawResponce(IPAddress(src->ipaddr), resp, 2 + cnt * 2, src->unitId);
+			return(Modbus::EX_SUCCESS);
+		}
+		case Modbus::FC_WRITE_REG:
+		case Modbus::FC_WRITE_REGS: {
+			// only the current limit can be written, it's handled by the load manager like any other request
+			uint16_t val;
+			if (fc == Modbus::FC_WRITE_REG && len == 5) {
+				val = getWord(&data[3]);
+			} else if (fc == Modbus::FC_WRITE_REGS && len == 8 && getWord(&data[3]) == 1 && data[5] == 2) {
+				val = getWord(&data[6]);
+			} else {
+				return(error(tcp, src, fc, Modbus::EX_ILLEGAL_VALUE));
+			}
+			if (getWord(&data[1]) != REG_CURR_LIMIT) {
+				return(error(tcp, src, fc, Modbus::EX_ILLEGAL_ADDRESS));
+			}
+			if (val != 0 && (val < CURR_ABS_MIN || val > CURR_ABS_MAX)) {
+				return(error(tcp, src, fc, Modbus::EX_ILLEGAL_VALUE));
+			}
+			LOG(m, "TCP write to box: %d Value: %d", id, val)
+			lm_storeRequest(id, val, LM_SRC_MBTCP);
+			tcp->setTransactionId(src->transactionId);
+			tcp->rawResponce(IPAddress(src->ipaddr), data, 5, src->unitId);   // echo fc, address and value/count
+			return(Modbus::EX_SUCCESS);
+		}
+		default:
+			return(error(tcp, src, fc, Modbus::EX_ILLEGAL_FUNCTION));
+	}
+}
+
+
+static Modbus::ResultCode cbTcpRaw(uint8_t *data, uint8_t len, void *custom) {
+	auto src = (Modbus::frame_arg_t*) custom;
+	Modbus::ResultCode res = mbs_request(&mbs, data, len, src);
+	if (res == Modbus::EX_PASSTHROUGH) {
+		// no wallbox with this unit id
+		return(error(&mbs, src, data[0], Modbus::EX_PATH_UNAVAILABLE));
+	}
+	return(res);
+}
+
+
+void mbs_setup() {
+	// In gateway modes the server of the gateway forwards the requests to mbs_request()
+	if (cfgMbServer && cfgModbusGWActive == 0) {
+		mbs.server();
+		mbs.onRaw(cbTcpRaw);
+		mbsActive = true;
+	}
+}
+
+
+void mbs_loop() {
+	if (mbsActive) {
+		mbs.task();
+	}
+}
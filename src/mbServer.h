@@ -0,0 +1,12 @@
+// Copyright (c) 2023 steff393, MIT license
+
+#ifndef MBSERVER_H
+#define MBSERVER_H
+
+#include <ModbusTCP.h>
+
+extern void               mbs_setup();
+extern void               mbs_loop();
+extern Modbus::ResultCode mbs_request(ModbusTCP *tcp, uint8_t *data, uint8_t len, Modbus::frame_arg_t *src);
+
+#endif /* MBSERVER_H */
@@ -3,11 +3,14 @@
 #include <Arduino.h>
 #ifdef ESP32
 #include <WiFi.h>
+#include <AsyncTCP.h>
 #else
 #include <ESP8266WiFi.h>
+#include <ESPAsyncTCP.h>
 #endif
 #include "globalConfig.h"
 #include "inverter.h"
+#include <LittleFS.h>
 #include "logger.h"
 #include "loadManager.h"
 #include "mbComm.h"
@@ -26,10 +29,261 @@ const bool	  lastWillRetain = true;
 WiFiClient espClient;
 PubSubClient client(espClient);
 uint32_t 	lastMsg = 0;
-uint32_t 	lastReconnect = 0;
 uint8_t   maxcurrent[WB_CNT];
+int8_t    lpBox[MQTT_MAX_LP + 1];     // box of each loadpoint, -1 if none
 boolean   callbackActive = false;
 
+#define MQTT_BACKOFF_MIN     2000   // [ms] first retry interval after a failed connection attempt
+#define MQTT_BACKOFF_MAX   300000   // [ms] max. retry interval, the interval is doubled after each failure
+#define MQTT_PROBE_TIMEOUT   3000   // [ms] max. time for the TCP probe of the broker
+#define MQTT_SOCKET_TIMEOUT     2   // [s] max. time to wait for the broker (PubSubClient default: 15s)
+
+typedef enum {
+	MQ_OFFLINE = 0,                  // waiting for the next attempt
+	MQ_PROBE,                        // non-blocking TCP connection to the broker is running
+	MQ_CONNECT,                      // broker is reachable, MQTT connect
+	MQ_SUBSCRIBE,                    // connected, subscribing one topic per loop
+	MQ_ONLINE
+} mqttState_t;
+
+typedef enum { PROBE_PENDING = 0, PROBE_OK, PROBE_FAILED } probeResult_t;
+
+static AsyncClient       probe;
+static volatile uint8_t  probeResult = PROBE_PENDING;
+static IPAddress         brokerIp;
+static mqttState_t       state     = MQ_OFFLINE;
+static uint32_t          stateTime = 0;
+static uint32_t          retryAt   = 0;
+static uint32_t          backoff   = MQTT_BACKOFF_MIN;
+static uint16_t          subIdx    = 0;
+
+#define MQTT_EVT_CNT           32   // number of events buffered in RAM during a broker outage
+#define MQTT_EVT_INTERVAL     100   // [ms] min. time between two replayed events
+#define MQTT_EVT_FILE  "/mqtt_evt.bin"  // events, which don't fit into RAM (if cfgMqttSpill > 0)
+
+typedef struct mqttEvent_struct {
+	uint32_t time;                   // unix time
+	uint32_t energy;                 // [Wh]
+	uint16_t limit;                  // current limit [0.1A]
+	uint8_t  box;
+	uint8_t  state;                  // charging state (register 5)
+} mqttEvent_t;
+
+static mqttEvent_t evtBuf[MQTT_EVT_CNT];
+static uint8_t     evtHead     = 0;
+static uint8_t     evtCnt      = 0;
+static int32_t     evtFileOfs  = -1; // read position in MQTT_EVT_FILE, -1 if no file
+static uint16_t    evtDropped  = 0;
+static uint32_t    evtLastSent = 0;
+static uint16_t    evtState[WB_CNT];   // last known state, 0xFFFF = unknown
+static uint16_t    evtLimit[WB_CNT];
+
+#define MQTT_LOG_LEN          400   // max. length of a batch of log lines
+#define MQTT_LOG_DELAY       1000   // [ms] max. time a log line waits for further lines
+#define MQTT_LOG_BURST          3   // token bucket: max. log messages sent at once
+#define MQTT_LOG_REFILL      2000   // [ms] token bucket: one further log message per interval
+
+static char        logBuf[MQTT_LOG_LEN + 40];   // + space for the 'dropped' note
+static uint16_t    logLen      = 0;
+static uint32_t    logTime     = 0;  // millis() of the oldest line in logBuf
+static uint16_t    logDropped  = 0;
+static uint8_t     logTokens   = MQTT_LOG_BURST;
+static uint32_t    logRefill   = 0;
+static boolean     logAccept   = false;  // decision for the current line, used for continuations (module 0)
+
+#define MQTT_RSSI_DEADBAND  3   // [dBm] min. change of the Wifi RSSI to be published
+#define MQTT_BUFFER_SIZE  512   // PubSubClient buffer, has to fit the topic and the log batch or the state document
+
+// values of a box, which are compared with the last published ones
+typedef enum {
+	V_STATE = 0, V_POWER, V_ENERGY, V_VOLT1, V_VOLT2, V_VOLT3, V_CURR1, V_CURR2, V_CURR3,
+	V_LIMIT, V_TEMP, V_RESCODE, V_RSSI, V_CHANNEL, V_PHASES, V_RFID, V_CNT
+} mqttVal_t;
+
+static int32_t  lastVal[WB_CNT][V_CNT];  // last published values
+static uint32_t lastFull[WB_CNT];        // millis() of the last full publish
+static uint32_t fullPending = 0xFFFFFFFF; // bitmask of the boxes (and globals), which need a full publish (start-up, reconnect)
+static uint32_t lastFullGlobal = 0;      // millis() of the last full publish of the global values
+static uint32_t lastGlobal  = 0;         // millis() of the last publish of the global values
+static uint32_t pubVer[WB_CNT];          // state version of each box, which was published
+static uint32_t pubLast     = 0;         // millis() of the last publish step
+static uint8_t  pubBox      = 0;         // next box to be checked by the publisher
+
+static uint32_t lastLatCnt[LM_SRC_CNT];  // number of requests, when the latency statistics were published
+static uint16_t ackSeq[WB_CNT];          // last acknowledged request of each box
+
+static const char srcName0[] PROGMEM = "internal";
+static const char srcName1[] PROGMEM = "openwb";
+static const char srcName2[] PROGMEM = "openwb2";
+static const char srcName3[] PROGMEM = "evcc";
+static const char srcName4[] PROGMEM = "web";
+static const char srcName5[] PROGMEM = "goe";
+static const char srcName6[] PROGMEM = "mbtcp";
+static PGM_P const srcName[LM_SRC_CNT] = { srcName0, srcName1, srcName2, srcName3, srcName4, srcName5, srcName6 };
+
+#define MQTT_FULL_GLOBAL  (1UL << WB_CNT)   // bit in fullPending for the global values
+#define MQTT_PUB_INTERVAL   20          // [ms] min. time between two publish steps
+static int32_t  lastInv[2];              // last published inverter values: pwrInv, pwrMet
+static int32_t  lastPv[2];               // last published pv values: mode, watt
+
+// topic families, the prefixes per loadpoint are built once, when the broker connects
+typedef enum { FAM_OWB = 0, FAM_OWB2, FAM_EVCC, FAM_CNT } mqttFamily_t;
+static const char famFmt0[] PROGMEM = "openWB/set/lp/%d";
+static const char famFmt1[] PROGMEM = "openWB/set/chargepoint/%d";
+static const char famFmt2[] PROGMEM = "wbec/lp/%d";
+static PGM_P const famFormat[FAM_CNT] = { famFmt0, famFmt1, famFmt2 };
+
+static char*    prefixPool = NULL;       // all prefixes, not terminated
+static uint16_t prefixOfs[WB_CNT][FAM_CNT];
+static uint8_t  prefixLen[WB_CNT][FAM_CNT];
+static char     topicBuf[50];
+static char     valueBuf[128];
+static char     stateBuf[MQTT_BUFFER_SIZE - 64];   // JSON document wbec/lp/N/state
+
+#define MQTT_MODE_TOPICS  0x01         // cfgMqttMode: one topic per value
+#define MQTT_MODE_JSON    0x02         // cfgMqttMode: wbec/lp/N/state
+
+typedef enum {
+	FMT_INT = 0,   // integer
+	FMT_UINT,      // unsigned integer
+	FMT_DEC1,      // 0.1 resolution, e.g. 12.3
+	FMT_KWH,       // Wh as kWh, e.g. 1.234
+	FMT_HEX,       // hexadecimal
+	FMT_PS,        // plug state 0/1
+	FMT_CS,        // charge state 0/1
+	FMT_STATUS,    // EVCC status A/B/C/F
+	FMT_PLUG,      // plug state true/false
+	FMT_CHARGE,    // charge state true/false
+	FMT_ENABLED,   // value > 0: true/false
+	FMT_RFID,      // last RFID tag
+	FMT_ARR,       // 3 integers (phases) as JSON array
+	FMT_ARR1       // 3 values (phases) with 0.1 resolution as JSON array
+} mqttFmt_t;
+
+typedef struct mqttTopic_struct {
+	char    suffix[20];
+	uint8_t family;
+	uint8_t val;                           // value, which triggers the publish (the 1st of 3 for arrays)
+	uint8_t fmt;
+} mqttTopic_t;
+
+static const mqttTopic_t topics[] PROGMEM = {
+	// openWB
+	{"/plugStat",            FAM_OWB,  V_STATE,   FMT_PS},
+	{"/chargeStat",          FAM_OWB,  V_STATE,   FMT_CS},
+	{"/W",                   FAM_OWB,  V_POWER,   FMT_INT},
+	{"/kWhCounter",          FAM_OWB,  V_ENERGY,  FMT_KWH},
+	{"/VPhase1",             FAM_OWB,  V_VOLT1,   FMT_INT},
+	{"/VPhase2",             FAM_OWB,  V_VOLT2,   FMT_INT},
+	{"/VPhase3",             FAM_OWB,  V_VOLT3,   FMT_INT},
+	{"/APhase1",             FAM_OWB,  V_CURR1,   FMT_DEC1},
+	{"/APhase2",             FAM_OWB,  V_CURR2,   FMT_DEC1},
+	{"/APhase3",             FAM_OWB,  V_CURR3,   FMT_DEC1},
+	// openWB 2.0 (#75)
+	{"/get/plug_state",      FAM_OWB2, V_STATE,   FMT_PLUG},
+	{"/get/charge_state",    FAM_OWB2, V_STATE,   FMT_CHARGE},
+	{"/get/power",           FAM_OWB2, V_POWER,   FMT_INT},
+	{"/get/imported",        FAM_OWB2, V_ENERGY,  FMT_UINT},
+	{"/get/voltages",        FAM_OWB2, V_VOLT1,   FMT_ARR},
+	{"/get/currents",        FAM_OWB2, V_CURR1,   FMT_ARR1},
+	{"/get/phases_in_use",   FAM_OWB2, V_PHASES,  FMT_INT},
+	{"/get/rfid_tag",        FAM_OWB2, V_RFID,    FMT_RFID},
+	// EVCC
+	{"/status",              FAM_EVCC, V_STATE,   FMT_STATUS},
+	{"/enabled",             FAM_EVCC, V_LIMIT,   FMT_ENABLED},
+	{"/power",               FAM_EVCC, V_POWER,   FMT_INT},
+	{"/energy",              FAM_EVCC, V_ENERGY,  FMT_KWH},
+	{"/currL1",              FAM_EVCC, V_CURR1,   FMT_DEC1},
+	{"/currL2",              FAM_EVCC, V_CURR2,   FMT_DEC1},
+	{"/currL3",              FAM_EVCC, V_CURR3,   FMT_DEC1},
+	{"/voltL1",              FAM_EVCC, V_VOLT1,   FMT_INT},
+	{"/voltL2",              FAM_EVCC, V_VOLT2,   FMT_INT},
+	{"/voltL3",              FAM_EVCC, V_VOLT3,   FMT_INT},
+	{"/currLimit",           FAM_EVCC, V_LIMIT,   FMT_DEC1},
+	{"/pcbTemp",             FAM_EVCC, V_TEMP,    FMT_DEC1},
+	{"/resCode",             FAM_EVCC, V_RESCODE, FMT_HEX},
+	{"/wifiRssi",            FAM_EVCC, V_RSSI,    FMT_INT},
+	{"/wifiChannel",         FAM_EVCC, V_CHANNEL, FMT_INT},
+	{"/plugState",           FAM_EVCC, V_STATE,   FMT_PLUG},
+	{"/chargeState",         FAM_EVCC, V_STATE,   FMT_CHARGE},
+};
+
+
+static void setCurrent(uint8_t box, uint16_t val, uint8_t src) {
+	// openWB and EVCC have 1A resolution, wbec has 0.1A resolution, so val has to be multiplied before
+	if (val == 0 || (val >= CURR_ABS_MIN && val <= CURR_ABS_MAX)) {
+		LOG(0, ", Write to box: %d Value: %d", box, val)
+		lm_storeRequest(box, val, src);
+	}
+}
+
+
+// topics for openWB
+static void onAConfigured(uint8_t box, const char* payload) {
+	setCurrent(box, atoi(payload) * 10, LM_SRC_OPENWB);
+}
+
+
+// topics for openWB 2.0 (#75), resolution is unclear (float with example value 12.34)
+static void onSetCurrent(uint8_t box, const char* payload) {
+	setCurrent(box, (uint16_t)(atof(payload) * 10), LM_SRC_OPENWB2);
+}
+
+
+// topics for EVCC
+static void onMaxCurrent(uint8_t box, const char* payload) {
+	setCurrent(box, (uint16_t)(atof(payload) * 10), LM_SRC_EVCC);
+}
+
+
+static void onEnable(uint8_t box, const char* payload) {
+	if (strstr_P(payload, PSTR("true"))) {
+		LOG(0, ", Enable box: %d", box)
+		lm_storeRequest(box, maxcurrent[box], LM_SRC_EVCC);
+	} else {
+		LOG(0, ", Disable box: %d", box)
+		lm_storeRequest(box, 0, LM_SRC_EVCC);
+	}
+}
+
+
+typedef void (*mqttHandler_t)(uint8_t box, const char* payload);
+
+typedef struct mqttRoute_struct {
+	char          pattern[34];             // '+' stands for the loadpoint number
+	mqttHandler_t handler;
+} mqttRoute_t;
+
+static const mqttRoute_t routes[] PROGMEM = {
+	{"openWB/lp/+/AConfigured",            onAConfigured},
+	{"openWB/chargepoint/+/set/current",   onSetCurrent},
+	{"wbec/lp/+/maxcurrent",               onMaxCurrent},
+	{"wbec/lp/+/enable",                   onEnable},
+};
+
+
+static boolean routeMatch(PGM_P pattern, const char* topic, uint16_t* lp) {
+	// compare topic and pattern in one pass, the segment '+' has to be a number and is returned in lp
+	char c;
+	while ((c = pgm_read_byte(pattern++)) != '\0') {
+		if (c == '+') {
+			if (*topic < '0' || *topic > '9') {
+				return(false);
+			}
+			*lp = 0;
+			while (*topic >= '0' && *topic <= '9') {
+				*lp = *lp * 10 + (*topic++ - '0');
+				if (*lp > MQTT_MAX_LP) {
+					return(false);
+				}
+			}
+		} else if (c != *topic++) {
+			return(false);
+		}
+	}
+	return(*topic == '\0');
+}
+
 
 void callback(char* topic, byte* payload, uint8_t length)
 {
@@ -42,89 +296,17 @@ void callback(char* topic, byte* payload, uint8_t length)
 	buffer[length] = '\0';			// add string termination
 	LOGEXT(m, "Received: %s, Payload: %s", topic, buffer)
 
-	// topics for openWB
-	if (strstr_P(topic, PSTR("openWB/lp/")) && strstr_P(topic, PSTR("/AConfigured"))) {
-		uint16_t val = atoi(buffer);
-		uint8_t lp  = topic[10] - '0'; 	// loadpoint nr.
-		uint8_t i;
-		// search, which index fits to loadpoint, first element will be selected
-		for (i = 0; i < cfgCntWb; i++) {
-			if (cfgMqttLp[i] == lp) {break;}
-		}
-		if (cfgMqttLp[i] == lp) {
-			// openWB has 1A resolution, wbec has 0.1A resolution
-			val = val * 10;
-			// set current
-			if (val == 0 || (val >= CURR_ABS_MIN && val <= CURR_ABS_MAX)) {
-				LOG(0, ", Write to box: %d Value: %d", i, val)
-				lm_storeRequest(i, val);
-			}
-		} else {
-			LOG(0, ", no box assigned", "");
-		}
-	}
-
-	// topics for openWB 2.0 (#75)
-	if (strstr_P(topic, PSTR("openWB/chargepoint/")) && strstr_P(topic, PSTR("/set/current"))) {
-		float val = atof(buffer);
-		uint8_t lp  = topic[19] - '0'; 	// loadpoint nr.
-		uint8_t i;
-		// search, which index fits to loadpoint, first element will be selected
-		for (i = 0; i < cfgCntWb; i++) {
-			if (cfgMqttLp[i] == lp) {break;}
-		}
-		if (cfgMqttLp[i] == lp) {
-			// openWB resolution is unclear (float with example value 12.34), wbec has 0.1A resolution
-			val = val * 10;
-			// set current
-			if (val == 0 || (val >= CURR_ABS_MIN && val <= CURR_ABS_MAX)) {
-				LOG(0, ", Write to box: %d Value: %d", i, (uint8_t)val)
-				lm_storeRequest(i, (uint8_t)val);
-			}
-		} else {
-			LOG(0, ", no box assigned", "");
-		}
-	}
-	
-	// topics for EVCC
-	if (strstr_P(topic, PSTR("wbec/lp/"))   && strstr_P(topic, PSTR("/maxcurrent"))) {
-		float val = atof(buffer);
-		uint8_t lp  = topic[8] - '0'; 	// loadpoint nr.
-		uint8_t i;
-		// search, which index fits to loadpoint, first element will be selected
-		for (i = 0; i < cfgCntWb; i++) {
-			if (cfgMqttLp[i] == lp) {break;}
-		}
-		if (cfgMqttLp[i] == lp) {
-			// EVCC has 1A resolution, wbec has 0.1A resolution
-			val = val * 10;
-			// set current
-			if (val == 0 || (val >= CURR_ABS_MIN && val <= CURR_ABS_MAX)) {
-				LOG(0, ", Write to box: %d Value: %d", i, (uint16_t) val)
-				lm_storeRequest(i, val);
-			}
-		} else {
-			LOG(0, ", no box assigned", "");
-		}
-	}
-
-	if (strstr_P(topic, PSTR("wbec/lp/"))   && strstr_P(topic, PSTR("/enable"))) {
-		uint8_t lp  = topic[8] - '0'; 	// loadpoint nr.
-		uint8_t i;
-		// search, which index fits to loadpoint, first element will be selected
-		for (i = 0; i < cfgCntWb; i++) {
-			if (cfgMqttLp[i] == lp) {break;}
-		}
-		if (cfgMqttLp[i] == lp) {
-			if (strstr_P(buffer, PSTR("true"))) {
-				LOG(0, ", Enable box: %d", i)
-				lm_storeRequest(i, maxcurrent[i]);
+	// loadpoint topics
+	for (uint8_t r = 0; r < sizeof(routes) / sizeof(routes[0]); r++) {
+		uint16_t lp;
+		if (routeMatch(routes[r].pattern, topic, &lp)) {
+			if (lpBox[lp] != -1) {
+				mqttHandler_t handler = (mqttHandler_t)pgm_read_ptr(&routes[r].handler);
+				handler(lpBox[lp], buffer);
 			} else {
-				LOG(0, ", Disable box: %d", i)
-				lm_storeRequest(i, 0);
+				LOG(0, ", no box assigned", "");
 			}
-		} else {
-			LOG(0, ", no box assigned", "");
+			break;
 		}
 	}
 
@@ -148,76 +330,102 @@ void callback(char* topic, byte* payload, uint8_t length)
 }
 
 
-void mqtt_begin() {
-	if (strcmp(cfgMqttIp, "") != 0) {
-  	client.setServer(cfgMqttIp, cfgMqttPort);
-		client.setCallback(callback);
-	}
-	for (uint8_t i = 0; i < cfgCntWb; i++) {
-		maxcurrent[i] = CURR_ABS_MIN;
+static void buildPrefixes() {
+	// topic prefixes of all loadpoints, computed once and stored back-to-back in one buffer
+	char tmp[30];
+	for (uint8_t pass = 0; pass < 2; pass++) {
+		uint16_t ofs = 0;
+		for (uint8_t i = 0; i < WB_CNT; i++) {
+			for (uint8_t f = 0; f < FAM_CNT; f++) {
+				prefixOfs[i][f] = ofs;
+				prefixLen[i][f] = 0;
+				if (i >= cfgCntWb || cfgMqttLp[i] == 0) {
+					continue;
+				}
+				prefixLen[i][f] = snprintf_P(tmp, sizeof(tmp), famFormat[f], cfgMqttLp[i]);
+				if (pass == 1) {
+					memcpy(&prefixPool[ofs], tmp, prefixLen[i][f]);
+				}
+				ofs += prefixLen[i][f];
+			}
+		}
+		if (pass == 0) {
+			prefixPool = (char*)malloc(ofs ? ofs : 1);
+		}
 	}
 }
 
-void reconnect() {
-	LOGN(m, "Attempting MQTT connection...", "");
-	// Create a random client ID
-	char clientId[10];
-	snprintf_P(clientId, sizeof(clientId), PSTR("wbec-%d"), (uint8_t)random(255));
 
-	// Attempt to connect
-	boolean con = false;
-	if (strcmp(cfgMqttUser, "") != 0 && strcmp(cfgMqttPass, "") != 0) {
-		con = client.connect(clientId, cfgMqttUser, cfgMqttPass, lastWillTopic, lastWillQos, lastWillRetain, lastWillMsgOff);
-	} else {
-		con = client.connect(clientId, lastWillTopic, lastWillQos, lastWillRetain, lastWillMsgOff);
-	}
-	if (con)
-	{
-		LOG(0, "connected", "");
-		//once connected to MQTT broker, subscribe command if any
-		for (uint8_t i = 0; i < cfgCntWb; i++) {
-			char topic[40];
-			if (cfgMqttLp[i] != 0) {
-				snprintf_P(topic, sizeof(topic), PSTR("openWB/lp/%d/AConfigured"), cfgMqttLp[i]);
-				client.subscribe(topic);
-				snprintf_P(topic, sizeof(topic), PSTR("wbec/lp/%d/enable"), cfgMqttLp[i]);
-				client.subscribe(topic);
-				snprintf_P(topic, sizeof(topic), PSTR("wbec/lp/%d/maxcurrent"), cfgMqttLp[i]);
-				client.subscribe(topic);
-			}
-		}
-		client.subscribe(cfgMqttWattTopic);
-	} else {
-		LOG(m, "failed, rc=%d try again in 5 seconds", client.state())
+static uint8_t fmtUint(char* buf, uint32_t val) {
+	char    tmp[10];
+	uint8_t n   = 0;
+	uint8_t len = 0;
+	do {
+		tmp[n++] = '0' + val % 10;
+		val /= 10;
+	} while (val);
+	while (n) {
+		buf[len++] = tmp[--n];
 	}
+	return(len);
 }
 
-void mqtt_handle() {
-	if (strcmp(cfgMqttIp, "") != 0) {
-		uint32_t now = millis();
 
-		if (!client.connected()) {
-			if (now - lastReconnect > 5000 || lastReconnect == 0) {
-				reconnect();
-				lastReconnect = now;
-			}
-		}
+static uint8_t fmtInt(char* buf, int32_t val) {
+	if (val < 0) {
+		buf[0] = '-';
+		return(1 + fmtUint(&buf[1], -(uint32_t)val));
+	}
+	return(fmtUint(buf, val));
+}
 
-		client.loop();
+
+static uint8_t fmtFix(char* buf, uint32_t val, uint8_t dec) {
+	// fixed point: val is given in units of 10^-dec, e.g. fmtFix(buf, 123, 1) = "12.3"
+	uint32_t div = 1;
+	for (uint8_t d = 0; d < dec; d++) {
+		div *= 10;
+	}
+	uint8_t len = fmtUint(buf, val / div);
+	buf[len++] = '.';
+	val %= div;
+	for (uint8_t d = 0; d < dec; d++) {
+		div /= 10;
+		buf[len++] = '0' + val / div;
+		val %= div;
 	}
+	return(len);
 }
 
 
-void mqtt_publish(uint8_t i) {
-	if (strcmp(cfgMqttIp, "") == 0 || cfgMqttLp[i] == 0) {
-		return;	// do nothing, when Mqtt is not configured, or box has no loadpoint assigned
+static uint8_t fmtHex(char* buf, uint32_t val) {
+	const char* digits = "0123456789abcdef";
+	char    tmp[8];
+	uint8_t n   = 0;
+	uint8_t len = 0;
+	do {
+		tmp[n++] = digits[val & 0x0F];
+		val >>= 4;
+	} while (val);
+	while (n) {
+		buf[len++] = tmp[--n];
 	}
-	
+	return(len);
+}
+
+
+static uint8_t fmtStr(char* buf, const char* s) {
+	uint8_t len = strlen(s);
+	memcpy(buf, s, len);
+	return(len);
+}
+
+
+static uint8_t fmtValue(char* buf, uint8_t fmt, uint8_t v, const int32_t* val) {
 	uint8_t ps = 0;
 	uint8_t cs = 0;
 	char status;
-
-	switch(content[i][1]) {
+	switch(val[V_STATE]) {
 		case 2:  ps = 0; cs = 0; status = 'A'; break;
 		case 3:  ps = 0; cs = 0; status = 'A'; break;
 		case 4:  ps = 1; cs = 0; status = 'B'; break;
@@ -227,183 +435,629 @@ void mqtt_publish(uint8_t i) {
 		default: ps = 0; cs = 0; status = 'F'; break; 
 	}
 
-	// publish the contents of box i
-	char header[30];
-	char topic[50];
-	char value[20];
-	
-	// topics for openWB
-	snprintf_P(header, sizeof(header), PSTR("openWB/set/lp/%d"), cfgMqttLp[i]);
-	boolean retain = true;
-	
-	snprintf_P(topic, sizeof(topic), PSTR("%s/plugStat"), header);
-	snprintf_P(value, sizeof(value), PSTR("%d"), ps);
-	client.publish(topic, value, retain);
+	uint8_t len = 0;
+	switch(fmt) {
+		case FMT_INT:    return(fmtInt(buf, val[v]));
+		case FMT_DEC1:   return(fmtFix(buf, val[v], 1));
+		case FMT_KWH:    return(fmtFix(buf, val[v], 3));
+		case FMT_UINT:   return(fmtUint(buf, val[v]));
+		case FMT_HEX:    return(fmtHex(buf, val[v]));
+		case FMT_PS:     buf[0] = '0' + ps; return(1);
+		case FMT_CS:     buf[0] = '0' + cs; return(1);
+		case FMT_STATUS: buf[0] = status;   return(1);
+		case FMT_PLUG:   return(fmtStr(buf, ps ? "true" : "false"));
+		case FMT_CHARGE: return(fmtStr(buf, cs ? "true" : "false"));
+		case FMT_ENABLED:return(fmtStr(buf, val[v] > 0 ? "true" : "false"));
+		case FMT_RFID:   return(fmtStr(buf, rfid_getLastID()));
+		case FMT_ARR:
+		case FMT_ARR1:
+			buf[len++] = '[';
+			for (uint8_t ph = 0; ph < 3; ph++) {
+				if (ph) {
+					buf[len++] = ',';
+				}
+				len += (fmt == FMT_ARR1) ? fmtFix(&buf[len], val[v + ph], 1) : fmtInt(&buf[len], val[v + ph]);
+			}
+			buf[len++] = ']';
+			return(len);
+	}
+	return(0);
+}
+
+
+static void publish(const char* topic, const char* value, uint8_t len) {
+	client.publish(topic, (const uint8_t*)value, len, true);	// all topics are retained
+}
+
 
-	snprintf_P(topic, sizeof(topic), PSTR("%s/chargeStat"), header);
-	snprintf_P(value, sizeof(value), PSTR("%d"), cs);
-	client.publish(topic, value, retain);
+static void publishGlobal(PGM_P topic, int32_t val) {
+	strcpy_P(topicBuf, topic);
+	publish(topicBuf, valueBuf, fmtInt(valueBuf, val));
+}
 
-	snprintf_P(topic, sizeof(topic), PSTR("%s/W"), header);
-	snprintf_P(value, sizeof(value), PSTR("%d"), content[i][10]);
-	client.publish(topic, value, retain);
 
-	snprintf_P(topic, sizeof(topic), PSTR("%s/kWhCounter"), header);
-	snprintf_P(value, sizeof(value), PSTR("%.3f"), (float)((uint32_t) content[i][13] << 16 | (uint32_t)content[i][14]) / 1000.0);
-	client.publish(topic, value, retain);
+static void publishState(uint8_t i, const int32_t* val) {
+	// one JSON document with all EVCC values of the box, written directly into the buffer
+	uint16_t len = 0;
+	stateBuf[len++] = '{';
+	for (uint8_t t = 0; t < sizeof(topics) / sizeof(topics[0]); t++) {
+		if (pgm_read_byte(&topics[t].family) != FAM_EVCC) {
+			continue;
+		}
+		uint8_t v     = pgm_read_byte(&topics[t].val);
+		uint8_t fmt   = pgm_read_byte(&topics[t].fmt);
+		boolean quote = (fmt == FMT_STATUS || fmt == FMT_HEX || fmt == FMT_RFID);
+		if (len > 1) {
+			stateBuf[len++] = ',';
+		}
+		stateBuf[len++] = '"';
+		strcpy_P(&stateBuf[len], topics[t].suffix + 1);   // key = topic without '/'
+		len += strlen(&stateBuf[len]);
+		stateBuf[len++] = '"';
+		stateBuf[len++] = ':';
+		if (quote) {
+			stateBuf[len++] = '"';
+		}
+		len += fmtValue(&stateBuf[len], fmt, v, val);
+		if (quote) {
+			stateBuf[len++] = '"';
+		}
+	}
+	stateBuf[len++] = '}';
+	memcpy(topicBuf, &prefixPool[prefixOfs[i][FAM_EVCC]], prefixLen[i][FAM_EVCC]);
+	strcpy_P(&topicBuf[prefixLen[i][FAM_EVCC]], PSTR("/state"));
+	client.publish(topicBuf, (const uint8_t*)stateBuf, len, true);
+}
 
-	for (uint8_t ph = 1; ph <= 3; ph++) {
-		snprintf_P(topic, sizeof(topic), PSTR("%s/VPhase%d"), header, ph);
-		snprintf_P(value, sizeof(value), PSTR("%d"), content[i][ph+5]);	// L1 = 6, L2 = 7, L3 = 8
-		client.publish(topic, value, retain);
+
+static void evtPush(const mqttEvent_t* evt) {
+	if (evtCnt == MQTT_EVT_CNT) {
+		// RAM buffer is full: move the oldest event to the file or drop it
+		File f;
+		if (cfgMqttSpill && (f = LittleFS.open(F(MQTT_EVT_FILE), "a"))) {
+			if (f.size() + sizeof(mqttEvent_t) <= cfgMqttSpill * 1024UL) {
+				f.write((const uint8_t*)&evtBuf[evtHead], sizeof(mqttEvent_t));
+				if (evtFileOfs == -1) {
+					evtFileOfs = 0;
+				}
+			} else {
+				evtDropped++;
+			}
+			f.close();
+		} else {
+			evtDropped++;
+		}
+		evtHead = (evtHead + 1) % MQTT_EVT_CNT;
+		evtCnt--;
 	}
+	evtBuf[(evtHead + evtCnt) % MQTT_EVT_CNT] = *evt;
+	evtCnt++;
+}
 
-	for (uint8_t ph = 1; ph <= 3; ph++) {
-		snprintf_P(topic, sizeof(topic), PSTR("%s/APhase%d"), header, ph);
-		snprintf_P(value, sizeof(value), PSTR("%.1f"), (float)content[i][ph+1]/10.0);	// L1 = 2, L2 = 3, L3 = 4
-		client.publish(topic, value, retain);
+
+static void evtRecord(uint8_t i) {
+	// charging state transitions and limit changes, recorded while the broker is not connected
+	if (content[i][1] == evtState[i] && content[i][53] == evtLimit[i]) {
+		return;
+	}
+	boolean first = evtState[i] == 0xFFFF;
+	evtState[i] = content[i][1];
+	evtLimit[i] = content[i][53];
+	if (first || state == MQ_SUBSCRIBE || state == MQ_ONLINE) {
+		return;
 	}
+	mqttEvent_t evt;
+	evt.time   = log_unixTime();
+	evt.energy = (uint32_t) content[i][13] << 16 | (uint32_t)content[i][14];
+	evt.limit  = content[i][53];
+	evt.box    = i;
+	evt.state  = content[i][1];
+	evtPush(&evt);
+}
+
 
-	LOG(m, "Publish to %s", header)
+static boolean evtPop(mqttEvent_t* evt) {
+	// events in the file are older than the ones in RAM
+	if (evtFileOfs != -1) {
+		File f = LittleFS.open(F(MQTT_EVT_FILE), "r");
+		if (f && f.seek(evtFileOfs) && f.read((uint8_t*)evt, sizeof(mqttEvent_t)) == sizeof(mqttEvent_t)) {
+			evtFileOfs += sizeof(mqttEvent_t);
+			f.close();
+			return(true);
+		}
+		if (f) {
+			f.close();
+		}
+		LittleFS.remove(F(MQTT_EVT_FILE));
+		evtFileOfs = -1;
+	}
+	if (evtCnt == 0) {
+		return(false);
+	}
+	*evt    = evtBuf[evtHead];
+	evtHead = (evtHead + 1) % MQTT_EVT_CNT;
+	evtCnt--;
+	return(true);
+}
 
-	// topics for openWB 2.0 (#75)
-	snprintf_P(header, sizeof(header), PSTR("openWB/set/chargepoint/%d"), cfgMqttLp[i]);
 
-	snprintf_P(topic, sizeof(topic), PSTR("%s/get/plug_state"), header);
-	snprintf_P(value, sizeof(value), PSTR("%s"), ps?"true":"false");
-	client.publish(topic, value, retain);
+static void evtReplay() {
+	// send the buffered events one by one with max. rate, so that the live traffic is not delayed
+	if ((evtCnt == 0 && evtFileOfs == -1) || millis() - evtLastSent < MQTT_EVT_INTERVAL) {
+		return;
+	}
+	evtLastSent = millis();
+	if (evtDropped) {
+		LOG(m, "Events dropped during broker outage: %d", evtDropped)
+		evtDropped = 0;
+	}
+	mqttEvent_t evt;
+	if (!evtPop(&evt) || cfgMqttLp[evt.box] == 0) {
+		return;
+	}
+	int32_t val[V_CNT];
+	val[V_STATE] = evt.state;
+	uint8_t len = 0;
+	len += fmtStr(&valueBuf[len], "{\"ts\":");
+	len += fmtUint(&valueBuf[len], evt.time);
+	len += fmtStr(&valueBuf[len], ",\"status\":\"");
+	len += fmtValue(&valueBuf[len], FMT_STATUS, V_STATE, val);
+	len += fmtStr(&valueBuf[len], "\",\"plugState\":");
+	len += fmtValue(&valueBuf[len], FMT_PLUG, V_STATE, val);
+	len += fmtStr(&valueBuf[len], ",\"chargeState\":");
+	len += fmtValue(&valueBuf[len], FMT_CHARGE, V_STATE, val);
+	len += fmtStr(&valueBuf[len], ",\"currLimit\":");
+	len += fmtFix(&valueBuf[len], evt.limit, 1);
+	len += fmtStr(&valueBuf[len], ",\"energy\":");
+	len += fmtFix(&valueBuf[len], evt.energy, 3);
+	valueBuf[len++] = '}';
+	memcpy(topicBuf, &prefixPool[prefixOfs[evt.box][FAM_EVCC]], prefixLen[evt.box][FAM_EVCC]);
+	strcpy_P(&topicBuf[prefixLen[evt.box][FAM_EVCC]], PSTR("/event"));
+	client.publish(topicBuf, (const uint8_t*)valueBuf, len, false);	// not retained, it's history
+}
 
-	snprintf_P(topic, sizeof(topic), PSTR("%s/get/charge_state"), header);
-	snprintf_P(value, sizeof(value), PSTR("%s"), cs?"true":"false");
-	client.publish(topic, value, retain);
 
-	snprintf_P(topic, sizeof(topic), PSTR("%s/get/power"), header);
-	snprintf_P(value, sizeof(value), PSTR("%d"), content[i][10]);
-	client.publish(topic, value, retain);
+static void logFlush(boolean full) {
+	// token bucket: max. MQTT_LOG_BURST messages at once, then one every MQTT_LOG_REFILL ms
+	uint32_t now = millis();
+	while (logTokens < MQTT_LOG_BURST && now - logRefill >= MQTT_LOG_REFILL) {
+		logTokens++;
+		logRefill += MQTT_LOG_REFILL;
+	}
+	if (logTokens == MQTT_LOG_BURST) {
+		logRefill = now;
+	}
+	if (logLen == 0 || logTokens == 0 || state != MQ_ONLINE) {
+		return;
+	}
+	if (!full && now - logTime < MQTT_LOG_DELAY && logLen < MQTT_LOG_LEN * 3 / 4) {
+		return;
+	}
+	if (logDropped) {
+		logLen += snprintf_P(&logBuf[logLen], MQTT_LOG_LEN + 40 - logLen, PSTR("(%d lines dropped)\n"), logDropped);
+		logDropped = 0;
+	}
+	client.publish("wbec/log", (const uint8_t*)logBuf, logLen, false);	// not retained, a batch is only a snippet of the log
+	logLen = 0;
+	logTokens--;
+}
 
-	snprintf_P(topic, sizeof(topic), PSTR("%s/get/imported"), header);
-	snprintf_P(value, sizeof(value), PSTR("%ld"), ((uint32_t) content[i][13] << 16 | (uint32_t)content[i][14]) );
-	client.publish(topic, value, retain);
 
-	snprintf_P(topic, sizeof(topic), PSTR("%s/get/voltages"), header);
-	snprintf_P(value, sizeof(value), PSTR("[%d,%d,%d]"), content[i][6], content[i][7], content[i][8]);	// L1 = 6, L2 = 7, L3 = 8
-	client.publish(topic, value, retain);
+static int32_t rfidHash(const char* id) {
+	uint32_t h = 5381;
+	while (*id) {
+		h = h * 33 + *id++;
+	}
+	return((int32_t)h);
+}
 
-	snprintf_P(topic, sizeof(topic), PSTR("%s/get/currents"), header);
-	snprintf_P(value, sizeof(value), PSTR("[%.1f,%.1f,%.1f]"), (float)content[i][2]/10.0, (float)content[i][3]/10.0, (float)content[i][4]/10.0);	// L1 = 2, L2 = 3, L3 = 4
-	client.publish(topic, value, retain);
 
-	snprintf_P(topic, sizeof(topic), PSTR("%s/get/phases_in_use"), header);
-	snprintf_P(value, sizeof(value), PSTR("%d"), cfgPvPhFactor / 23);
-	client.publish(topic, value, retain);
-	
-	snprintf_P(topic, sizeof(topic), PSTR("%s/get/rfid_tag"), header);
-	snprintf_P(value, sizeof(value), PSTR("%s"), rfid_getLastID());
-	client.publish(topic, value, retain);
+static boolean changed(int32_t* last, int32_t val, int32_t band, boolean full) {
+	// publish when the value moved by more than the deadband since it was sent, or when it reaches/leaves 0
+	// the difference is calculated in 64 bit, it overflows in 32 bit e.g. for the rfid hash
+	if (full || (val != *last && (llabs((int64_t)val - *last) > band || (val == 0) != (*last == 0)))) {
+		*last = val;
+		return(true);
+	}
+	return(false);
+}
 
-	// topics for EVCC
-	snprintf_P(header, sizeof(header), PSTR("wbec/lp/%d"), cfgMqttLp[i]);
 
-	snprintf_P(topic, sizeof(topic), PSTR("%s/status"), header);
-	snprintf_P(value, sizeof(value), PSTR("%c"), status);
-	client.publish(topic, value, retain);
+void mqtt_publish(uint8_t i) {
+	if (strcmp(cfgMqttIp, "") == 0 || cfgMqttLp[i] == 0) {
+		return;	// do nothing, when Mqtt is not configured, or box has no loadpoint assigned
+	}
 
-	snprintf_P(topic, sizeof(topic), PSTR("%s/enabled"), header);
 	if (content[i][53] > 0) {
-		client.publish(topic, "true", retain);
 		maxcurrent[i] = content[i][53];       // memorize the current limit if not 0
-	} else {
-		client.publish(topic, "false", retain);
-	}
-
-	snprintf_P(topic, sizeof(topic), PSTR("%s/power"), header);
-	snprintf_P(value, sizeof(value), PSTR("%d"), content[i][10]);
-	client.publish(topic, value, retain);
-
-	snprintf_P(topic, sizeof(topic), PSTR("%s/energy"), header);
-	snprintf_P(value, sizeof(value), PSTR("%.3f"), (float)((uint32_t) content[i][13] << 16 | (uint32_t)content[i][14]) / 1000.0);
-	client.publish(topic, value, retain);
-	
-	for (uint8_t ph = 1; ph <= 3; ph++) {
-		snprintf_P(topic, sizeof(topic), PSTR("%s/currL%d"), header, ph);
-		snprintf_P(value, sizeof(value), PSTR("%.1f"), (float)content[i][ph+1]/10.0);	// L1 = 2, L2 = 3, L3 = 4
-		client.publish(topic, value, retain);
-	}
-	
-	for (uint8_t ph = 1; ph <= 3; ph++) {
-		snprintf_P(topic, sizeof(topic), PSTR("%s/voltL%d"), header, ph);
-		snprintf_P(value, sizeof(value), PSTR("%d"), content[i][ph+5]);	// L1 = 2, L2 = 3, L3 = 4
-		client.publish(topic, value, retain);
-	}
-	snprintf_P(topic, sizeof(topic), PSTR("%s/currLimit"), header);
-	snprintf_P(value, sizeof(value), PSTR("%.1f"), (float)content[i][53]/10.0);
-	client.publish(topic, value, retain);
-
-	snprintf_P(topic, sizeof(topic), PSTR("%s/pcbTemp"), header);
-	snprintf_P(value, sizeof(value), PSTR("%.1f"), (float)content[i][5]/10.0);
-	client.publish(topic, value, retain);
-
-	snprintf_P(topic, sizeof(topic), PSTR("%s/resCode"), header);
-	snprintf_P(value, sizeof(value), PSTR("%s"), String(modbusResultCode[i], HEX));
-	client.publish(topic, value, retain);
-
-	int qrssi = WiFi.RSSI();     
-	snprintf_P(topic, sizeof(topic), PSTR("%s/wifiRssi"), header);
-	snprintf_P(value, sizeof(value), PSTR("%d"), qrssi);
-	client.publish(topic, value, retain);
-	snprintf_P(topic, sizeof(topic), PSTR("%s/wifiChannel"), header);
-	snprintf_P(value, sizeof(value), PSTR("%d"), WiFi.channel());
-	client.publish(topic, value, retain);
-
-	snprintf_P(topic, sizeof(topic), PSTR("%s/plugState"), header);
-	snprintf_P(value, sizeof(value), PSTR("%s"), ps?"true":"false");
-	client.publish(topic, value, retain);
-
-	snprintf_P(topic, sizeof(topic), PSTR("%s/chargeState"), header);
-	snprintf_P(value, sizeof(value), PSTR("%s"), cs?"true":"false");
-	client.publish(topic, value, retain);
-
-	
-	// publish values from inverter
-	if (strcmp(cfgInverterIp, "") != 0) {
-		snprintf_P(header, sizeof(header), PSTR("wbec/inverter"));
+	}
 
-		snprintf_P(topic, sizeof(topic), PSTR("%s/pwrInv"), header);
-		snprintf_P(value, sizeof(value), PSTR("%d"), inverter_getPwrInv());
-		client.publish(topic, value, retain);
+	evtRecord(i);
+	if (state != MQ_SUBSCRIBE && state != MQ_ONLINE) {
+		return;	// not connected, state changes are buffered by evtRecord()
+	}
 
-		snprintf_P(topic, sizeof(topic), PSTR("%s/pwrMet"), header);
-		snprintf_P(value, sizeof(value), PSTR("%d"), inverter_getPwrMet());
-		client.publish(topic, value, retain);
+	// all topics are published periodically (and after a reconnect), in between only the changed values
+	boolean full = cfgMqttRefresh == 0 || (fullPending & (1UL << i)) || millis() - lastFull[i] > cfgMqttRefresh * 60000UL;
+	if (full) {
+		lastFull[i]  = millis();
+		fullPending &= ~(1UL << i);
+	}
+	int32_t* last = lastVal[i];
+	uint32_t chg  = 0;
+	int32_t  val[V_CNT];
+	val[V_STATE]   = content[i][1];
+	val[V_POWER]   = content[i][10];
+	val[V_ENERGY]  = (uint32_t) content[i][13] << 16 | (uint32_t)content[i][14];
+	for (uint8_t ph = 0; ph < 3; ph++) {
+		val[V_VOLT1 + ph] = content[i][ph+6];	// L1 = 6, L2 = 7, L3 = 8
+		val[V_CURR1 + ph] = content[i][ph+2];	// L1 = 2, L2 = 3, L3 = 4
+	}
+	val[V_LIMIT]   = content[i][53];
+	val[V_TEMP]    = content[i][5];
+	val[V_RESCODE] = modbusResultCode[i];
+	val[V_RSSI]    = WiFi.RSSI();
+	val[V_CHANNEL] = WiFi.channel();
+	val[V_PHASES]  = cfgPvPhFactor / 23;
+	val[V_RFID]    = rfidHash(rfid_getLastID());
+	for (uint8_t v = 0; v < V_CNT; v++) {
+		int32_t band = 0;
+		if (v == V_POWER) { band = cfgMqttDeadband; }
+		if (v == V_RSSI)  { band = MQTT_RSSI_DEADBAND; }
+		if (changed(&last[v], val[v], band, full)) {
+			chg |= 1UL << v;
+		}
+	}
+
+	// publish the contents of box i: openWB, openWB 2.0 (#75) and EVCC topics
+	for (uint8_t t = 0; (cfgMqttMode & MQTT_MODE_TOPICS) && t < sizeof(topics) / sizeof(topics[0]); t++) {
+		uint8_t  fam  = pgm_read_byte(&topics[t].family);
+		uint8_t  v    = pgm_read_byte(&topics[t].val);
+		uint8_t  fmt  = pgm_read_byte(&topics[t].fmt);
+		uint32_t mask = (fmt == FMT_ARR || fmt == FMT_ARR1) ? 7UL << v : 1UL << v;
+		if (!(chg & mask)) {
+			continue;
+		}
+		memcpy(topicBuf, &prefixPool[prefixOfs[i][fam]], prefixLen[i][fam]);
+		strcpy_P(&topicBuf[prefixLen[i][fam]], topics[t].suffix);
+		publish(topicBuf, valueBuf, fmtValue(valueBuf, fmt, v, val));
+	}
+	// and/or all EVCC values as one JSON document
+	if ((cfgMqttMode & MQTT_MODE_JSON) && chg) {
+		publishState(i, val);
+	}
+	if (chg) {
+		LOG(m, "Publish to LP %d", cfgMqttLp[i])
+	}
+}
+
+
+static void publishLatency(boolean full) {
+	// statistics of the time from a request (per source) until it's confirmed by the box
+	for (uint8_t src = 0; src < LM_SRC_CNT; src++) {
+		const lmLatency_t* l = lm_getLatency(src);
+		uint32_t cnt = l->cnt + l->timeout;
+		if (cnt == 0 || (!full && cnt == lastLatCnt[src])) {
+			continue;
+		}
+		lastLatCnt[src] = cnt;
+		uint8_t len = 0;
+		len += fmtStr(&valueBuf[len], "{\"cnt\":");
+		len += fmtUint(&valueBuf[len], l->cnt);
+		len += fmtStr(&valueBuf[len], ",\"timeout\":");
+		len += fmtUint(&valueBuf[len], l->timeout);
+		len += fmtStr(&valueBuf[len], ",\"avg\":");
+		len += fmtUint(&valueBuf[len], l->cnt ? l->sum / l->cnt : 0);
+		len += fmtStr(&valueBuf[len], ",\"min\":");
+		len += fmtUint(&valueBuf[len], l->min);
+		len += fmtStr(&valueBuf[len], ",\"max\":");
+		len += fmtUint(&valueBuf[len], l->max);
+		valueBuf[len++] = '}';
+		strcpy_P(topicBuf, PSTR("wbec/latency/"));
+		strcat_P(topicBuf, srcName[src]);
+		publish(topicBuf, valueBuf, len);
+	}
+}
+
+
+static void publishAcks() {
+	// optional acknowledge of confirmed requests with applied value and latency
+	for (uint8_t i = 0; i < cfgCntWb; i++) {
+		uint8_t  val;
+		uint8_t  src;
+		uint32_t lat;
+		uint16_t seq = lm_getAck(i, &val, &lat, &src);
+		if (seq == ackSeq[i]) {
+			continue;
+		}
+		ackSeq[i] = seq;
+		if (!cfgMqttAck || cfgMqttLp[i] == 0) {
+			continue;
+		}
+		uint8_t len = 0;
+		len += fmtStr(&valueBuf[len], "{\"currLimit\":");
+		len += fmtFix(&valueBuf[len], val, 1);
+		len += fmtStr(&valueBuf[len], ",\"latency\":");
+		len += fmtUint(&valueBuf[len], lat);
+		len += fmtStr(&valueBuf[len], ",\"src\":\"");
+		strcpy_P(&valueBuf[len], srcName[src]);
+		len += strlen(&valueBuf[len]);
+		len += fmtStr(&valueBuf[len], "\"}");
+		memcpy(topicBuf, &prefixPool[prefixOfs[i][FAM_EVCC]], prefixLen[i][FAM_EVCC]);
+		strcpy_P(&topicBuf[prefixLen[i][FAM_EVCC]], PSTR("/ack"));
+		client.publish(topicBuf, (const uint8_t*)valueBuf, len, false);
+	}
+}
+
+
+static void publishGlobals() {
+	// values, which don't belong to a box
+	boolean full = cfgMqttRefresh == 0 || (fullPending & MQTT_FULL_GLOBAL) || millis() - lastFullGlobal > cfgMqttRefresh * 60000UL;
+	if (full) {
+		lastFullGlobal = millis();
+		fullPending   &= ~MQTT_FULL_GLOBAL;
+	}
+
+	// publish values from inverter
+	if (strcmp(cfgInverterIp, "") != 0) {
+		if (changed(&lastInv[0], inverter_getPwrInv(), cfgMqttDeadband, full)) {
+			publishGlobal(PSTR("wbec/inverter/pwrInv"), inverter_getPwrInv());
+		}
+		if (changed(&lastInv[1], inverter_getPwrMet(), cfgMqttDeadband, full)) {
+			publishGlobal(PSTR("wbec/inverter/pwrMet"), inverter_getPwrMet());
+		}
 	}
 
 	// publish values from pvAlgo
 	if (pv_getMode()) {
-		snprintf_P(header, sizeof(header), PSTR("wbec/pv"));
+		if (changed(&lastPv[0], pv_getMode(), 0, full)) {
+			publishGlobal(PSTR("wbec/pv/mode"), pv_getMode());
+		}
+		if (changed(&lastPv[1], pv_getWatt(), cfgMqttDeadband, full)) {
+			publishGlobal(PSTR("wbec/pv/watt"), pv_getWatt());
+		}
+	}
+
+	publishLatency(full);
+
+	// Wbec-Connection Status, also sent by brokerConnect()
+	if (full) {
+		client.publish(lastWillTopic, lastWillMsgOn, lastWillRetain);
+	}
+}
+
+
+static void publishStep() {
+	// Publisher, independent of the Modbus timing: max. one box per MQTT_PUB_INTERVAL,
+	// when its state version has changed or a full publish is due
+	if (millis() - pubLast < MQTT_PUB_INTERVAL) {
+		return;
+	}
+	boolean online = (state == MQ_SUBSCRIBE || state == MQ_ONLINE);
+	if (online) {
+		publishAcks();
+	}
+	// cfgMqttRefresh = 0: all topics every Modbus cycle, also without change
+	uint32_t refresh = cfgMqttRefresh ? cfgMqttRefresh * 60000UL : cfgMbCycleTime * 1000UL;
+	// no wallbox data in exclusive gateway mode, and none of a box, which was never read
+	for (uint8_t n = 0; n < cfgCntWb && cfgModbusGWActive != 1; n++) {
+		uint8_t i = pubBox;
+		pubBox = (pubBox + 1) % cfgCntWb;
+		boolean due = online && ((fullPending & (1UL << i)) || millis() - lastFull[i] >= refresh);
+		if (cfgMqttLp[i] != 0 && mb_isValid(i) && (mb_getVersion(i) != pubVer[i] || due)) {
+			pubVer[i] = mb_getVersion(i);
+			pubLast   = millis();
+			mqtt_publish(i);
+			return;
+		}
+	}
+	if (online && millis() - lastGlobal >= cfgMbCycleTime * 1000UL) {
+		lastGlobal = millis();
+		pubLast    = millis();
+		publishGlobals();
+	}
+}
 
-		snprintf_P(topic, sizeof(topic), PSTR("%s/mode"), header);
-		snprintf_P(value, sizeof(value), PSTR("%d"), pv_getMode());
-		client.publish(topic, value, retain);
 
-		snprintf_P(topic, sizeof(topic), PSTR("%s/watt"), header);
-		snprintf_P(value, sizeof(value), PSTR("%ld"), pv_getWatt());
-		client.publish(topic, value, retain);
+void mqtt_begin() {
+	if (strcmp(cfgMqttIp, "") != 0) {
+  	client.setServer(cfgMqttIp, cfgMqttPort);
+		client.setCallback(callback);
+		client.setBufferSize(MQTT_BUFFER_SIZE);
+		client.setSocketTimeout(MQTT_SOCKET_TIMEOUT);
+		espClient.setTimeout(MQTT_SOCKET_TIMEOUT * 1000);
+		// the probe runs in the background, its callbacks only report the result to mqtt_handle()
+		probe.onConnect([](void* arg, AsyncClient* c) {
+			brokerIp    = c->remoteIP();
+			probeResult = PROBE_OK;
+		});
+		probe.onError([](void* arg, AsyncClient* c, int8_t error) {
+			probeResult = PROBE_FAILED;
+		});
+		probe.onTimeout([](void* arg, AsyncClient* c, uint32_t time) {
+			probeResult = PROBE_FAILED;
+		});
+	}
+	for (uint8_t i = 0; i < cfgCntWb; i++) {
+		maxcurrent[i] = CURR_ABS_MIN;
+	}
+	memset(evtState, 0xFF, sizeof(evtState));	// no state known yet
+	// events spilled before a reboot are still unsent, replay them after the next connect
+	if (LittleFS.exists(F(MQTT_EVT_FILE))) {
+		if (cfgMqttSpill) {
+			evtFileOfs = 0;
+		} else {
+			LittleFS.remove(F(MQTT_EVT_FILE));
+		}
 	}
+	// if a loadpoint is assigned several times, the first box will be selected
+	memset(lpBox, -1, sizeof(lpBox));
+	for (int8_t i = cfgCntWb - 1; i >= 0; i--) {
+		if (cfgMqttLp[i] != 0) {
+			lpBox[cfgMqttLp[i]] = i;
+		}
+	}
+}
+
 
-	// Wbec-Connection Status
-	client.publish(lastWillTopic, lastWillMsgOn, lastWillRetain);
+static void retryLater() {
+	LOGW(m, "failed, rc=%d try again in %d seconds", client.state(), backoff / 1000)
+	probe.close(true);
+	state   = MQ_OFFLINE;
+	retryAt = millis() + backoff;
+	backoff = min(backoff * 2, (uint32_t)MQTT_BACKOFF_MAX);
 }
 
-void mqtt_log(const char *output, const char *msg) {
+
+static boolean brokerConnect() {
+	// Create a random client ID
+	char clientId[10];
+	snprintf_P(clientId, sizeof(clientId), PSTR("wbec-%d"), (uint8_t)random(255));
+
+	// Attempt to connect, broker is known to be reachable, so this takes max. MQTT_SOCKET_TIMEOUT
+	boolean con = false;
+	client.setServer(brokerIp, cfgMqttPort);   // IP resolved by the probe, avoids a blocking DNS request
+	if (strcmp(cfgMqttUser, "") != 0 && strcmp(cfgMqttPass, "") != 0) {
+		con = client.connect(clientId, cfgMqttUser, cfgMqttPass, lastWillTopic, lastWillQos, lastWillRetain, lastWillMsgOff);
+	} else {
+		con = client.connect(clientId, lastWillTopic, lastWillQos, lastWillRetain, lastWillMsgOff);
+	}
+	if (con)
+	{
+		LOG(0, "connected", "");
+		client.publish(lastWillTopic, lastWillMsgOn, lastWillRetain);
+		fullPending = 0xFFFFFFFF;	// broker might have lost the retained topics
+		if (prefixPool == NULL) {
+			buildPrefixes();
+		}
+	}
+	return(con);
+}
+
+
+static boolean subscribeNext() {
+	// once connected to MQTT broker, subscribe command if any: one topic per call, returns true when all are done
+	uint8_t routeCnt = sizeof(routes) / sizeof(routes[0]);
+	while (subIdx < cfgCntWb * routeCnt) {
+		uint8_t i = subIdx / routeCnt;
+		uint8_t r = subIdx % routeCnt;
+		subIdx++;
+		if (cfgMqttLp[i] == 0) {
+			continue;
+		}
+		char topic[40];
+		char lp[4];
+		uint8_t len = 0;
+		snprintf_P(lp, sizeof(lp), PSTR("%d"), cfgMqttLp[i]);
+		for (PGM_P p = routes[r].pattern; pgm_read_byte(p) != '\0' && len < sizeof(topic) - sizeof(lp); p++) {
+			if (pgm_read_byte(p) == '+') {
+				len += strlcpy(&topic[len], lp, sizeof(topic) - len);
+			} else {
+				topic[len++] = pgm_read_byte(p);
+			}
+		}
+		topic[len] = '\0';
+		client.subscribe(topic);
+		return(false);
+	}
+	client.subscribe(cfgMqttWattTopic);
+	return(true);
+}
+
+
+void mqtt_handle() {
+	if (strcmp(cfgMqttIp, "") == 0) {
+		return;
+	}
+
+	publishStep();
+
+	switch (state) {
+		case MQ_OFFLINE:
+			if ((int32_t)(millis() - retryAt) >= 0 && WiFi.status() == WL_CONNECTED) {
+				LOGN(m, "Attempting MQTT connection...", "");
+				// first check (non-blocking) that the broker accepts TCP connections at all
+				probeResult = PROBE_PENDING;
+				if (probe.connect(cfgMqttIp, cfgMqttPort)) {
+					state     = MQ_PROBE;
+					stateTime = millis();
+				} else {
+					retryLater();
+				}
+			}
+			break;
+		case MQ_PROBE:
+			if (probeResult == PROBE_OK) {
+				probe.close(true);
+				state = MQ_CONNECT;
+			} else if (probeResult == PROBE_FAILED || millis() - stateTime > MQTT_PROBE_TIMEOUT) {
+				retryLater();
+			}
+			break;
+		case MQ_CONNECT:
+			if (brokerConnect()) {
+				state  = MQ_SUBSCRIBE;
+				subIdx = 0;
+			} else {
+				retryLater();
+			}
+			break;
+		case MQ_SUBSCRIBE:
+			if (subscribeNext()) {
+				state   = MQ_ONLINE;
+				backoff = MQTT_BACKOFF_MIN;
+			}
+			break;
+		case MQ_ONLINE:
+			evtReplay();
+			logFlush(false);
+			break;
+	}
+
+	if (state == MQ_SUBSCRIBE || state == MQ_ONLINE) {
+		if (!client.connected()) {
+			LOGW(m, "connection lost", "");
+			state   = MQ_OFFLINE;
+			retryAt = millis();
+			return;
+		}
+		client.loop();
+	}
+}
+
+
+void mqtt_log(uint8_t module, uint8_t level, const char *output, const char *msg, boolean newLine) {
 	if (strcmp(cfgMqttIp, "") == 0 || callbackActive) {
 		return;	// do nothing, when Mqtt is not configured OR when request comes from mqtt callback (#13)
 	}
 
-	boolean retain = true;
-	char topic[10];
-	char value[150];
+	// module 0 continues the line of the previous call
+	if (module != 0) {
+		logAccept = level <= cfgMqttLog[module];
+	}
+	if (!logAccept) {
+		return;
+	}
 
-	snprintf_P(topic, sizeof(topic), PSTR("wbec/log"), "");
-	snprintf_P(value, sizeof(value), PSTR("%s%s"), output, msg);
-	client.publish(topic, value, retain);
+	// lines are collected and sent as batch by logFlush()
+	uint16_t len = strlen(output) + strlen(msg) + (newLine ? 1 : 0);
+	if (logLen + len >= MQTT_LOG_LEN) {
+		logFlush(true);	// make room, if the token bucket allows it
+	}
+	if (logLen > 0 && logLen + len >= MQTT_LOG_LEN) {
+		logDropped++;
+		logAccept = false;	// don't append the continuations of a dropped line
+		return;
+	}
+	if (logLen == 0) {
+		logTime = millis();
+	}
+	// a line longer than a batch is truncated
+	uint16_t size = MQTT_LOG_LEN - logLen - (newLine ? 1 : 0);
+	int n = snprintf_P(&logBuf[logLen], size, PSTR("%s%s"), output, msg);
+	logLen += (n < size) ? n : size - 1;
+	if (newLine) {
+		logBuf[logLen++] = '\n';
+		logBuf[logLen]   = '\0';
+	}
 }
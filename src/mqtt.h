@@ -6,6 +6,6 @@
 extern void mqtt_begin();
 extern void mqtt_handle();
 extern void mqtt_publish(uint8_t i);
-extern void mqtt_log(const char *output, const char *msg);
+extern void mqtt_log(uint8_t module, uint8_t level, const char *output, const char *msg, boolean newLine);
 
 #endif /* MQTT_H */
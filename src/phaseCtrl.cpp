@@ -103,7 +103,7 @@ void httpCall(boolean state) {
 		log(m, F("HTTP Response code: ") + String(httpResponseCode) + ", " + http.getString());
 	}
 	else {
-		log(m, F("Error code: ") + String(httpResponseCode));
+		log(m, F("Error code: ") + String(httpResponseCode), true, LOG_WARN);
 	}
 	http.end();
 }
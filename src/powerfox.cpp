@@ -77,7 +77,7 @@ void powerfox_loop() {
 		// Parse JSON object
 		DeserializationError error = deserializeJson(doc, response);
 		if (error) {
-			LOG(m, "deserializeJson() failed: %s", error.f_str())
+			LOGW(m, "deserializeJson() failed: %s", error.f_str())
 			return;
 		} 
 
@@ -3,11 +3,11 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include "globalConfig.h"
-#include <LittleFS.h>
 #include "logger.h"
 #include "loadManager.h"
 #include "mbComm.h"
 #include "pvAlgo.h"
+#include "pvLog.h"
 #include <RTCVars.h>
 
 
@@ -80,23 +80,7 @@ void pvAlgo() {
 	Serial.print("Watt="); Serial.print(watt); Serial.print(", availPower="); Serial.print(availPower); Serial.print(", targetCurr="); Serial.println(targetCurr);
 
 
-	FSInfo fs_info;   
-	LittleFS.info(fs_info);
-	uint32_t time = log_unixTime();
-	if ((time < 2085000000UL) &&                                // 26.01.2036 --> sometimes there are large values (e.g. 2085985724) which are wrong -> ignore them
-			(fs_info.totalBytes - fs_info.usedBytes > 512000)) {    // 500kB should remain free
-		File logFile = LittleFS.open(F("/pv.txt"), "a"); // Write the time and the temperature to the csv file
-		logFile.print(time);
-		logFile.print(";");
-		logFile.print(watt);
-		logFile.print(";");
-		logFile.print(content[BOXID][10]);
-		logFile.print(";");
-		logFile.print(actualCurr);
-		logFile.print(";");
-		logFile.println(targetCurr);
-		logFile.close();
-	}
+	pvLog_add(log_unixTime(), watt, content[BOXID][10]);
 
 	if ((targetCurr != actualCurr)) {														// update the value not too often 
 		lm_storeRequest(BOXID, targetCurr);
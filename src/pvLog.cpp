@@ -0,0 +1,609 @@
+// Copyright (c) 2023 steff393, MIT license
+
+#include <Arduino.h>
+#include "globalConfig.h"
+#include <LittleFS.h>
+#include "logger.h"
+#include "pvLog.h"
+
+#define PVLOG_FS_RESERVE 102400         // [byte] keep free on LittleFS, checked only when a ring grows
+#define PVLOG_FS_CHECK   3600000UL      // [ms] interval to update the free space from LittleFS, it's estimated in between
+#define PVLOG_SEG_SIZE   4096           // [byte] size of a segment file
+#define PVLOG_CUR_FILE   "/pv0.cur"     // level 0: block, which is filled currently
+#define PVLOG_CSV_FILE   "/pv.txt"      // history of former versions: time;watt;power;actual current;target current
+#define PVLOG_BUF_CNT    (PVLOG_PAGE / sizeof(pvRec_t))   // records buffered in RAM per rollup level
+#define PVLOG_FLUSH_TIME 300000UL       // [ms] write the buffered records at least every 5 min
+#define PVLOG_SAMPLE_MAX 16             // [byte] max. size of one compressed sample: flags + 3 varints
+#define PVLOG_TIME_MIN   1600000000UL   // samples without valid time (no NTP yet) are ignored
+#define PVLOG_TIME_MAX   2085000000UL   // 26.01.2036 --> sometimes there are large values (e.g. 2085985724) which are wrong -> ignore them
+
+// flags of a compressed sample, a varint follows for every set flag
+#define PVLOG_F_TIME     0x01           // delta-of-delta of the time is not 0
+#define PVLOG_F_WATT     0x02           // watt changed
+#define PVLOG_F_POWER    0x04           // power changed
+
+const uint8_t m = 11;
+
+// Every level is a ring of segment files in its own directory, e.g. /pv1/17. Level 0 keeps each
+// sample in compressed blocks of one flash page: the first sample in the block header, then per
+// sample a flag byte and zig-zag varints for the delta-of-delta of the time and the deltas of the
+// values, only if not 0. The other levels keep min/avg/max of fixed intervals as fixed-size records,
+// so a chart of any time span needs only a limited number of records.
+// LittleFS is copy-on-write, so the files are only appended: new data is collected in RAM and
+// appended page by page, when a ring is full, its oldest segment is deleted. The position of a
+// record follows from its sequence number, the segments are numbered in the same way.
+typedef struct {
+	const char *dir;
+	uint32_t    res;                // [s] interval of one record, 0 = every sample
+	uint8_t     segCnt;             // max. segments in the ring
+} pvLevel_t;
+
+static const pvLevel_t level[PVLOG_LEVEL_CNT] = {
+	{ "/pv0",    0, 12 },           // samples: 16 blocks per segment, ca. 6 days at 30s cycle time in 48kB
+	{ "/pv1",  300,  9 },           // 5 min: 256 records per segment, > 7 days
+	{ "/pv2", 3600, 36 },           // 1 h: > 1 year
+};
+
+static uint32_t next[PVLOG_LEVEL_CNT];     // next record (level 0: block) to be appended
+static uint32_t firstSeg[PVLOG_LEVEL_CNT]; // oldest segment of the ring
+static pvAcc_t  acc[PVLOG_LEVEL_CNT];      // open interval of the levels > 0
+static pvRec_t  buf[PVLOG_LEVEL_CNT - 1][PVLOG_BUF_CNT];   // levels > 0, index l - 1
+static uint8_t  pending[PVLOG_LEVEL_CNT];  // records in buf (level 0: samples in block), which are not yet written
+static uint8_t  block[PVLOG_PAGE];         // level 0: block, which is filled currently, saved in PVLOG_CUR_FILE
+static pvDecoder_t enc;                    // level 0: last sample in block
+static uint32_t lastFlush   = 0;
+static uint32_t fsFree      = 0;           // [byte] estimated free space on LittleFS
+static uint32_t lastFsCheck = 0;
+
+
+static uint32_t recSize(uint8_t l) {
+	return(l == 0 ? PVLOG_PAGE : sizeof(pvRec_t));
+}
+
+
+static uint32_t segRecs(uint8_t l) {
+	return(PVLOG_SEG_SIZE / recSize(l));
+}
+
+
+static void segName(char *name, size_t size, uint8_t l, uint32_t seg) {
+	snprintf_P(name, size, PSTR("%s/%lu"), level[l].dir, (unsigned long)seg);
+}
+
+
+static uint32_t firstSeq(uint8_t l) {
+	return(firstSeg[l] * segRecs(l));
+}
+
+
+static boolean readAt(File &f, uint32_t *fileSeg, uint8_t l, uint32_t seq, uint8_t *dst, size_t size) {
+	// the segment stays open in f for the next read
+	uint32_t seg = seq / segRecs(l);
+	if (!f || *fileSeg != seg) {
+		char name[16];
+		segName(name, sizeof(name), l, seg);
+		f        = LittleFS.open(name, "r");
+		*fileSeg = seg;
+		if (!f) {
+			return(false);
+		}
+	}
+	f.seek((seq % segRecs(l)) * recSize(l), SeekSet);
+	return(f.read(dst, size) == size);
+}
+
+
+static boolean readRec(File &f, uint32_t *fileSeg, uint8_t l, uint32_t seq, pvRec_t *rec) {
+	return(readAt(f, fileSeg, l, seq, (uint8_t *)rec, sizeof(pvRec_t)));
+}
+
+
+static boolean readBlock(File &f, uint32_t *fileSeg, uint32_t seq, uint8_t *blk, size_t size) {
+	// size = sizeof(pvBlock_t): only the header
+	const pvBlock_t *hdr = (const pvBlock_t *)blk;
+	return(readAt(f, fileSeg, 0, seq, blk, size) && hdr->seq == seq && hdr->cnt > 0 && hdr->len <= PVLOG_PAGE);
+}
+
+
+static uint8_t putVarint(uint8_t *p, int32_t val) {
+	// zig-zag: small negative values get short codes as well
+	uint32_t v = ((uint32_t)val << 1) ^ (uint32_t)(val >> 31);
+	uint8_t  n = 0;
+	while (v >= 0x80) {
+		p[n++] = (uint8_t)v | 0x80;
+		v >>= 7;
+	}
+	p[n++] = (uint8_t)v;
+	return(n);
+}
+
+
+static int32_t getVarint(const uint8_t *p, uint16_t *pos) {
+	uint32_t v     = 0;
+	uint8_t  shift = 0;
+	uint8_t  b;
+	do {
+		b = p[(*pos)++];
+		v |= (uint32_t)(b & 0x7F) << shift;
+		shift += 7;
+	} while ((b & 0x80) && shift < 35 && *pos < PVLOG_PAGE);
+	return((int32_t)(v >> 1) ^ -(int32_t)(v & 1));
+}
+
+
+static void decodeStart(pvDecoder_t *d, const uint8_t *blk) {
+	// the first sample is in the header
+	const pvBlock_t *hdr = (const pvBlock_t *)blk;
+	d->time  = hdr->time;
+	d->delta = 0;
+	d->watt  = hdr->watt;
+	d->power = hdr->power;
+	d->left  = hdr->cnt - 1;
+	d->pos   = sizeof(pvBlock_t);
+}
+
+
+static void decodeNext(pvDecoder_t *d, const uint8_t *blk) {
+	if (d->pos >= ((const pvBlock_t *)blk)->len) {
+		d->left = 0;        // corrupt block
+		return;
+	}
+	uint8_t flags = blk[d->pos++];
+	if (flags & PVLOG_F_TIME) {
+		d->delta += getVarint(blk, &d->pos);
+	}
+	d->time += d->delta;
+	if (flags & PVLOG_F_WATT) {
+		d->watt += getVarint(blk, &d->pos);
+	}
+	if (flags & PVLOG_F_POWER) {
+		d->power += getVarint(blk, &d->pos);
+	}
+	d->left--;
+}
+
+
+static void accAdd(pvAcc_t *a, const pvRec_t *rec) {
+	if (a->cnt == 0) {
+		a->rec      = *rec;
+		a->wattSum  = 0;
+		a->powerSum = 0;
+	}
+	a->wattSum  += rec->wattAvg;
+	a->powerSum += rec->powerAvg;
+	a->rec.wattMin  = min(a->rec.wattMin,  rec->wattMin);
+	a->rec.wattMax  = max(a->rec.wattMax,  rec->wattMax);
+	a->rec.powerMin = min(a->rec.powerMin, rec->powerMin);
+	a->rec.powerMax = max(a->rec.powerMax, rec->powerMax);
+	a->cnt++;
+}
+
+
+static void accGet(pvAcc_t *a, pvRec_t *rec) {
+	*rec = a->rec;
+	rec->wattAvg  = a->wattSum  / a->cnt;
+	rec->powerAvg = a->powerSum / a->cnt;
+	a->cnt = 0;
+}
+
+
+static void checkFs() {
+	FSInfo fs_info;
+	LittleFS.info(fs_info);
+	fsFree      = fs_info.totalBytes - fs_info.usedBytes;
+	lastFsCheck = millis();
+}
+
+
+static boolean segStart(uint8_t l) {
+	// new segment: delete the oldest ones, when the ring is full, otherwise the ring grows: check the free space
+	uint32_t seg = next[l] / segRecs(l);
+	if (seg - firstSeg[l] >= level[l].segCnt) {
+		while (seg - firstSeg[l] >= level[l].segCnt) {
+			char name[16];
+			segName(name, sizeof(name), l, firstSeg[l]++);
+			LittleFS.remove(name);
+		}
+		return(true);
+	}
+	if (fsFree < PVLOG_FS_RESERVE + PVLOG_SEG_SIZE || millis() - lastFsCheck > PVLOG_FS_CHECK) {
+		checkFs();
+	}
+	if (fsFree < PVLOG_FS_RESERVE + PVLOG_SEG_SIZE) {
+		LOGW(m, "No space for %s", level[l].dir);
+		return(false);
+	}
+	fsFree -= PVLOG_SEG_SIZE;
+	return(true);
+}
+
+
+static void append(uint8_t l, const uint8_t *data, uint8_t cnt) {
+	// append the records to the segments, a new segment is started at the boundary
+	uint8_t done = 0;
+	while (done < cnt) {
+		if (next[l] % segRecs(l) == 0 && !segStart(l)) {
+			return;
+		}
+		char name[16];
+		segName(name, sizeof(name), l, next[l] / segRecs(l));
+		File f = LittleFS.open(name, "a");
+		if (!f) {
+			return;
+		}
+		uint32_t n = min((uint32_t)(cnt - done), segRecs(l) - next[l] % segRecs(l));
+		f.write(&data[done * recSize(l)], n * recSize(l));
+		f.close();
+		next[l] += n;
+		done    += n;
+	}
+}
+
+
+static void flush(uint8_t l) {
+	// level 0: save the current block in its own small file, others: append the buffered records
+	if (pending[l] == 0) {
+		return;
+	}
+	if (l == 0) {
+		File f = LittleFS.open(F(PVLOG_CUR_FILE), "w");
+		if (f) {
+			f.write(block, PVLOG_PAGE);
+			f.close();
+		}
+	} else {
+		append(l, (const uint8_t *)buf[l - 1], pending[l]);
+	}
+	pending[l] = 0;
+}
+
+
+static void addRec(uint8_t l, const pvRec_t *rec) {
+	buf[l - 1][pending[l]++] = *rec;
+	if ((next[l] + pending[l]) % PVLOG_BUF_CNT == 0) {
+		flush(l);   // page is complete
+	}
+}
+
+
+static void addSample(uint32_t time, int16_t watt, uint16_t power) {
+	pvBlock_t *hdr = (pvBlock_t *)block;
+	if (hdr->cnt > 0 && hdr->len + PVLOG_SAMPLE_MAX > PVLOG_PAGE) {
+		// block is full: append it and continue with the next one
+		append(0, block, 1);
+		hdr->cnt = 0;
+	}
+	if (hdr->cnt == 0) {
+		memset(block, 0, sizeof(block));
+		hdr->seq   = next[0];
+		hdr->time  = time;
+		hdr->watt  = watt;
+		hdr->power = power;
+		hdr->cnt   = 1;
+		hdr->len   = sizeof(pvBlock_t);
+		decodeStart(&enc, block);
+	} else {
+		int32_t  delta = (int32_t)(time - enc.time);
+		uint16_t len   = hdr->len + 1;
+		uint8_t  flags = 0;
+		if (delta != enc.delta) {
+			flags |= PVLOG_F_TIME;
+			len   += putVarint(&block[len], delta - enc.delta);
+		}
+		if (watt != enc.watt) {
+			flags |= PVLOG_F_WATT;
+			len   += putVarint(&block[len], (int32_t)watt - enc.watt);
+		}
+		if (power != enc.power) {
+			flags |= PVLOG_F_POWER;
+			len   += putVarint(&block[len], (int32_t)power - enc.power);
+		}
+		block[hdr->len] = flags;
+		hdr->len  = len;
+		hdr->cnt++;
+		enc.time  = time;
+		enc.delta = delta;
+		enc.watt  = watt;
+		enc.power = power;
+	}
+	pending[0] = 1;
+}
+
+
+static uint32_t oldestTime(uint8_t l) {
+	// the records in RAM are newer than the ones in the files
+	pvRec_t   rec;
+	pvBlock_t hdr;
+	File      f;
+	uint32_t  seg = UINT32_MAX;
+	if (l == 0) {
+		if (next[0] == firstSeq(0)) {
+			return(((pvBlock_t *)block)->cnt ? ((pvBlock_t *)block)->time : UINT32_MAX);
+		}
+		return(readBlock(f, &seg, firstSeq(0), (uint8_t *)&hdr, sizeof(hdr)) ? hdr.time : UINT32_MAX);
+	}
+	if (next[l] == firstSeq(l)) {
+		return(pending[l] ? buf[l - 1][0].time : UINT32_MAX);
+	}
+	return(readRec(f, &seg, l, firstSeq(l), &rec) ? rec.time : UINT32_MAX);
+}
+
+
+static void importCsv() {
+	// the history of former versions is taken over once, when no history exists yet, then the file is removed
+	// the currents are not kept, the history has only the grid power and the charging power
+	File f = LittleFS.open(F(PVLOG_CSV_FILE), "r");
+	if (!f) {
+		return;
+	}
+	boolean empty = ((pvBlock_t *)block)->cnt == 0;
+	for (uint8_t l = 0; l < PVLOG_LEVEL_CNT; l++) {
+		empty = empty && next[l] == firstSeq(l);
+	}
+	uint32_t cnt = 0;
+	if (empty) {
+		uint8_t chunk[PVLOG_PAGE];
+		char    line[48];
+		uint8_t len = 0;
+		size_t  n;
+		while ((n = f.read(chunk, sizeof(chunk))) > 0) {
+			for (size_t i = 0; i < n; i++) {
+				if (chunk[i] != '\n') {
+					if (len < sizeof(line) - 1) {
+						line[len++] = chunk[i];
+					}
+					continue;
+				}
+				line[len] = '\0';
+				len = 0;
+				char *p = line;
+				uint32_t time = strtoul(p, &p, 10);
+				if (*p != ';') {
+					continue;
+				}
+				int32_t watt = strtol(p + 1, &p, 10);
+				if (*p != ';') {
+					continue;
+				}
+				pvLog_add(time, watt, strtoul(p + 1, &p, 10));
+				cnt++;
+			}
+			yield();
+		}
+		pvLog_flush();
+	}
+	f.close();
+	LittleFS.remove(F(PVLOG_CSV_FILE));
+	LOG(m, "%s: %lu samples imported", PVLOG_CSV_FILE, (unsigned long)cnt);
+}
+
+
+void pvLog_setup() {
+	for (uint8_t l = 0; l < PVLOG_LEVEL_CNT; l++) {
+		// the ring continues after the newest segment
+		boolean  found   = false;
+		uint32_t lastSeg = 0;
+		uint32_t size    = 0;
+		firstSeg[l] = 0;
+		Dir dir = LittleFS.openDir(level[l].dir);
+		while (dir.next()) {
+			uint32_t seg = strtoul(dir.fileName().c_str(), NULL, 10);
+			if (!found || seg < firstSeg[l]) {
+				firstSeg[l] = seg;
+			}
+			if (!found || seg > lastSeg) {
+				lastSeg = seg;
+				size    = dir.fileSize();
+			}
+			found = true;
+		}
+		next[l] = lastSeg * segRecs(l) + min(size / recSize(l), segRecs(l));
+	}
+
+	// continue the block, which was filled before the reset
+	pvBlock_t *hdr = (pvBlock_t *)block;
+	File f = LittleFS.open(F(PVLOG_CUR_FILE), "r");
+	if (f && f.read(block, PVLOG_PAGE) == PVLOG_PAGE && hdr->seq == next[0] && hdr->cnt > 0 && hdr->len <= PVLOG_PAGE) {
+		decodeStart(&enc, block);
+		while (enc.left > 0) {
+			decodeNext(&enc, block);
+		}
+	} else {
+		memset(block, 0, sizeof(block));
+	}
+	checkFs();
+	lastFlush = millis();
+	importCsv();
+}
+
+
+void pvLog_loop() {
+	if (millis() - lastFlush >= PVLOG_FLUSH_TIME) {
+		pvLog_flush();
+	}
+}
+
+
+void pvLog_flush(boolean shutdown) {
+	if (shutdown) {
+		// also the open intervals, otherwise they are lost
+		for (uint8_t l = 1; l < PVLOG_LEVEL_CNT; l++) {
+			if (acc[l].cnt) {
+				pvRec_t roll;
+				accGet(&acc[l], &roll);
+				addRec(l, &roll);
+			}
+		}
+	}
+	for (uint8_t l = 0; l < PVLOG_LEVEL_CNT; l++) {
+		flush(l);
+	}
+	lastFlush = millis();
+}
+
+
+void pvLog_add(uint32_t time, int32_t watt, uint16_t power) {
+	if (time < PVLOG_TIME_MIN || time > PVLOG_TIME_MAX) {
+		return;
+	}
+	pvRec_t rec;
+	rec.time     = time;
+	rec.wattAvg  = constrain((watt + (watt >= 0 ? 5 : -5)) / 10, INT16_MIN, INT16_MAX);
+	rec.wattMin  = rec.wattAvg;
+	rec.wattMax  = rec.wattAvg;
+	rec.powerAvg = power;
+	rec.powerMin = power;
+	rec.powerMax = power;
+	addSample(time, rec.wattAvg, power);
+
+	// rollups: write the interval, when the sample belongs to the next one
+	for (uint8_t l = 1; l < PVLOG_LEVEL_CNT; l++) {
+		uint32_t start = time - time % level[l].res;
+		if (acc[l].cnt && acc[l].rec.time != start) {
+			pvRec_t roll;
+			accGet(&acc[l], &roll);
+			addRec(l, &roll);
+		}
+		accAdd(&acc[l], &rec);
+		acc[l].rec.time = start;
+	}
+}
+
+
+void pvLog_queryBegin(pvQuery_t *q, uint32_t from, uint32_t to, uint16_t points) {
+	// nothing is written here, the records in RAM are read after the ones in the files
+	// use the finest level, which has not more than 'points' records in the range and which covers 'from'
+	// points = 0: every sample, e.g. for export
+	uint32_t width = points ? (to > from ? to - from : 1) / points : 0;
+	uint8_t  l     = 0;
+	uint32_t oldest = oldestTime(0);
+	while (points && l + 1 < PVLOG_LEVEL_CNT) {
+		uint32_t oldestNext = oldestTime(l + 1);
+		if (level[l + 1].res <= width || (oldest > from && oldestNext < oldest)) {
+			l++;
+			oldest = oldestNext;
+		} else {
+			break;
+		}
+	}
+	q->level    = l;
+	q->from     = from;
+	q->to       = to;
+	q->width    = max(max(width, level[l].res), (uint32_t)1);
+	q->acc.cnt  = 0;
+	q->dec.left = 0;
+	q->done     = false;
+	q->seg      = UINT32_MAX;
+
+	// binary search for the first record in the files in the range (records are sorted by time)
+	// level 0: the block before contains also samples in the range
+	uint32_t lo = firstSeq(l);
+	uint32_t hi = next[l];
+	while (lo < hi) {
+		pvRec_t   rec;
+		pvBlock_t hdr;
+		uint32_t  mid = lo + (hi - lo) / 2;
+		boolean   before;
+		if (l == 0) {
+			before = readBlock(q->file, &q->seg, mid, (uint8_t *)&hdr, sizeof(hdr)) && hdr.time < from;
+		} else {
+			before = readRec(q->file, &q->seg, l, mid, &rec) && rec.time < from;
+		}
+		if (before) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	q->seq = (l == 0 && lo > firstSeq(l)) ? lo - 1 : lo;
+}
+
+
+static boolean queryRec(pvQuery_t *q, pvRec_t *rec) {
+	// next record of the level from the files, then from RAM, level 0: decode the blocks sample by sample
+	// records, which can't be read (e.g. segment deleted meanwhile), are skipped
+	uint8_t l = q->level;
+	if (q->done) {
+		return(false);
+	}
+	if (l != 0) {
+		for (;; q->seq++) {
+			if (q->seq < next[l]) {
+				if (readRec(q->file, &q->seg, l, q->seq, rec)) {
+					break;
+				}
+			} else if (q->seq < next[l] + pending[l]) {
+				*rec = buf[l - 1][q->seq - next[l]];
+				break;
+			} else {
+				return(false);
+			}
+		}
+		q->seq++;
+		return(true);
+	}
+	if (q->dec.left > 0) {
+		decodeNext(&q->dec, q->block);
+	} else {
+		for (;; q->seq++) {
+			if (q->seq < next[0]) {
+				if (readBlock(q->file, &q->seg, q->seq, q->block, PVLOG_PAGE)) {
+					break;
+				}
+			} else if (q->seq == next[0] && ((pvBlock_t *)block)->cnt > 0) {
+				memcpy(q->block, block, PVLOG_PAGE);
+				break;
+			} else {
+				return(false);
+			}
+		}
+		q->seq++;
+		decodeStart(&q->dec, q->block);
+	}
+	rec->time     = q->dec.time;
+	rec->wattAvg  = q->dec.watt;
+	rec->wattMin  = q->dec.watt;
+	rec->wattMax  = q->dec.watt;
+	rec->powerAvg = q->dec.power;
+	rec->powerMin = q->dec.power;
+	rec->powerMax = q->dec.power;
+	return(true);
+}
+
+
+uint16_t pvLog_queryNext(pvQuery_t *q, char *buf, uint16_t size) {
+	// one line per point: time;watt;power;wattMin;wattMax;powerMin;powerMax
+	pvRec_t  rec;
+	boolean  full = false;
+	while (!full && queryRec(q, &rec)) {
+		if (rec.time > q->to) {
+			q->done = true;
+			break;
+		}
+		if (rec.time < q->from) {
+			continue;       // before the range or time was set back
+		}
+		uint32_t point = q->from + ((rec.time - q->from) / q->width) * q->width;
+		if (q->acc.cnt && q->acc.rec.time != point) {
+			// the point is complete, this record starts the next one
+			pvRec_t out;
+			accGet(&q->acc, &out);
+			accAdd(&q->acc, &rec);
+			q->acc.rec.time = point;
+			rec  = out;
+			full = true;
+		} else {
+			accAdd(&q->acc, &rec);
+			q->acc.rec.time = point;
+		}
+	}
+	if (!full) {
+		if (q->acc.cnt == 0) {
+			return(0);      // everything sent
+		}
+		accGet(&q->acc, &rec);
+	}
+	int n = snprintf_P(buf, size, PSTR("%lu;%ld;%u;%ld;%ld;%u;%u\n"), (unsigned long)rec.time,
+		(long)rec.wattAvg * 10, rec.powerAvg, (long)rec.wattMin * 10, (long)rec.wattMax * 10, rec.powerMin, rec.powerMax);
+	return(min(n, size - 1));
+}
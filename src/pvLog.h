@@ -0,0 +1,67 @@
+// Copyright (c) 2023 steff393, MIT license
+#ifndef PVLOG_H
+#define PVLOG_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#define PVLOG_LEVEL_CNT 3
+#define PVLOG_PAGE      256            // [byte] flash page, records are written in whole pages, when possible
+
+typedef struct {
+	uint32_t time;                 // start of the interval (unixtime)
+	int16_t  wattAvg;              // [10W] grid power (neg. = 'Einspeisung', pos. = 'Bezug')
+	int16_t  wattMin;              // [10W]
+	int16_t  wattMax;              // [10W]
+	uint16_t powerAvg;             // [W] charging power of the box
+	uint16_t powerMin;             // [W]
+	uint16_t powerMax;             // [W]
+} pvRec_t;
+
+typedef struct {
+	int32_t  wattSum;
+	int32_t  powerSum;
+	pvRec_t  rec;                  // min/max and start time, avg is calculated at the end
+	uint16_t cnt;
+} pvAcc_t;
+
+typedef struct {
+	uint32_t seq;                  // sequence number, to detect old blocks in the ring
+	uint32_t time;                 // first sample of the block
+	int16_t  watt;                 // [10W]
+	uint16_t power;                // [W]
+	uint16_t cnt;                  // samples in the block, incl. the first one
+	uint16_t len;                  // [byte] used, incl. this header
+} pvBlock_t;                       // level 0: followed by the compressed samples up to PVLOG_PAGE
+
+typedef struct {
+	uint32_t time;                 // last decoded sample
+	int32_t  delta;                // [s] time difference to the sample before
+	int16_t  watt;                 // [10W]
+	uint16_t power;                // [W]
+	uint16_t left;                 // samples in the block, which are not yet decoded
+	uint16_t pos;                  // [byte] position of the next sample in the block
+} pvDecoder_t;
+
+typedef struct {
+	File     file;                 // segment, which was read last
+	uint32_t seg;                  // number of this segment
+	uint8_t  level;
+	boolean  done;                 // end of the range reached
+	uint32_t seq;                  // next record to read
+	uint32_t from;
+	uint32_t to;
+	uint32_t width;                // [s] width of one returned point
+	pvAcc_t  acc;                  // point, which is currently collected
+	pvDecoder_t dec;               // level 0: position in the current block
+	uint8_t  block[PVLOG_PAGE];    // level 0: current block, copied from the file or from RAM
+} pvQuery_t;
+
+extern void     pvLog_setup();
+extern void     pvLog_loop();
+extern void     pvLog_flush(boolean shutdown = false);
+extern void     pvLog_add(uint32_t time, int32_t watt, uint16_t power);
+extern void     pvLog_queryBegin(pvQuery_t *q, uint32_t from, uint32_t to, uint16_t points);
+extern uint16_t pvLog_queryNext(pvQuery_t *q, char *buf, uint16_t size);
+
+#endif /* PVLOG_H */
@@ -50,7 +50,7 @@ void shelly_loop() {
 		LOG(m, "HTTP Response code: %d, %s", httpResponseCode, response);
 	}
 	else {
-		LOG(m, "Error code: %d", httpResponseCode);
+		LOGW(m, "Error code: %d", httpResponseCode);
 	}
 	http.end();
 
@@ -58,7 +58,7 @@ void shelly_loop() {
 	// Parse JSON object
 	DeserializationError error = deserializeJson(doc, response);
 	if (error) {
-		LOG(m, "deserializeJson() failed: %s", error.f_str())
+		LOGW(m, "deserializeJson() failed: %s", error.f_str())
 		return;
 	} 
 
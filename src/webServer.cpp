@@ -5,6 +5,7 @@
 #include <AsyncJson.h>
 #include <ArduinoJson.h>
 #include "button.h"
+#include "chargeLog.h"
 #ifdef ESP32
 #include <WiFi.h>
 #include <ESPmDNS.h>
@@ -14,6 +15,7 @@
 #endif
 #include <ESPAsyncTCP.h>
 #include <ESPAsyncWebServer.h>
+#include "gateway.h"
 #include "globalConfig.h"
 #include "goEmulator.h"
 #include "inverter.h"
@@ -24,6 +26,7 @@
 #include "phaseCtrl.h"
 #include "powerfox.h"
 #include "pvAlgo.h"
+#include "pvLog.h"
 #include "rfid.h"
 #include <SPIFFSEditor.h>
 #include "webServer.h"
@@ -32,6 +35,13 @@
 
 #define PFOX_JSON_LEN 256
 #define GPIO_JSON_LEN  32
+#define JSON_PART_LEN      640  // /json is streamed in parts, the largest one is a box incl. logStr
+#define WEB_CACHE_CNT        4  // cached responses of /status and /pv
+#define WEB_CACHE_TTL    10000  // [ms] render again after this time, even when the state is unchanged (millis, rssi)
+#define WEB_CACHE_PV      0xFF  // cache key of /pv, /status uses (id << 1 | fromApp)
+#define WEB_POLL_CNT         4  // parked long-poll requests /json?since=
+#define WEB_POLL_TIMEOUT 25000  // [ms] answer a long-poll at the latest after this time
+#define WEB_EVT_INTERVAL   250  // [ms] check for state changes for long-poll and events
 
 static const uint8_t m = 3;
 
@@ -40,6 +50,38 @@ static AsyncWebServer server(80);
 static boolean resetRequested = false;
 static boolean resetwifiRequested = false;
 
+typedef struct {
+	boolean  used;
+	uint8_t  key;
+	uint32_t ver;                  // state version, the body was rendered for
+	uint32_t time;                 // [ms] time of rendering
+	uint32_t etag;                 // unique for each rendered body
+	String   body;
+} webCache_t;
+
+static webCache_t cache[WEB_CACHE_CNT];
+static uint32_t   cacheEtag = 0;
+static uint32_t   bootId    = 0;  // part of the ETags, so that they are not reused after a restart
+static uint32_t   stateSum  = 0;
+static uint32_t   stateVer  = 0;
+
+typedef struct {
+	AsyncWebServerRequest *request;  // NULL: slot is free
+	uint32_t since;
+	uint32_t start;
+	uint8_t  from;
+	uint8_t  to;
+} webPoll_t;
+
+static webPoll_t        longPoll[WEB_POLL_CNT];
+static AsyncEventSource events("/events");
+static boolean          eventFull = false;   // send all values, e.g. when a new client connected
+static uint32_t         eventVer  = 0;
+static uint32_t         eventBoxSum[WB_CNT];
+static pvMode_t         eventPvMode = PV_DISABLED;
+static int32_t          eventPvWatt = 0;
+static uint32_t         lastStateCheck = 0;
+
 
 static void onRequest(AsyncWebServerRequest *request){
 	//Handle Unknown Request
@@ -71,7 +113,327 @@ static uint8_t getSignalQuality(int rssi)
 }
 
 
+typedef struct {
+	uint8_t  from;
+	uint8_t  to;
+	uint8_t  part;                 // next part to render: header, one part per box, trailer
+	uint16_t len;                  // length of the current part in buf
+	uint16_t pos;                  // bytes of the current part already sent
+	char     buf[JSON_PART_LEN];
+} jsonStream_t;
+
+
+static uint16_t jsonEscape(char *dst, const char *src, uint16_t maxLen) {
+	// copy a string and escape it for json, control characters are replaced by blanks
+	uint16_t len = 0;
+	for (; *src && len + 2 < maxLen; src++) {
+		if (*src == '"' || *src == '\\') {
+			dst[len++] = '\\';
+			dst[len++] = *src;
+		} else if ((uint8_t)*src < 0x20) {
+			dst[len++] = ' ';
+		} else {
+			dst[len++] = *src;
+		}
+	}
+	dst[len] = '\0';
+	return(len);
+}
+
+
+static void jsonAppend(char *buf, uint16_t *len, PGM_P fmt, ...) {
+	// snprintf to the end of buf, truncated if necessary, len never exceeds the buffer
+	va_list args;
+	va_start(args, fmt);
+	int n = vsnprintf_P(&buf[*len], JSON_PART_LEN - *len, fmt, args);
+	va_end(args);
+	*len = min((uint16_t)(*len + max(n, 0)), (uint16_t)(JSON_PART_LEN - 1));
+}
+
+
+static uint16_t jsonHeader(char *buf, uint8_t from) {
+	uint16_t len = 0;
+	jsonAppend(buf, &len, PSTR("{\"wbec\":{\"version\":\"%s\",\"bldDate\":\"%s\",\"timeNow\":\"%s\"},\"box\":["),
+		cfgWbecVersion, cfgBuildDate, log_time().c_str());
+	for (uint8_t i = 0; i < from; i++) {
+		// box[] always starts with index 0, so fill the boxes which are not requested
+		jsonAppend(buf, &len, PSTR("null,"));
+	}
+	return(len);
+}
+
+
+static uint16_t jsonBox(char *buf, uint8_t i, boolean first) {
+	uint32_t energyP = (uint32_t) content[i][11] << 16 | (uint32_t)content[i][12];
+	uint32_t energyI = (uint32_t) content[i][13] << 16 | (uint32_t)content[i][14];
+	uint32_t energyC = goE_getEnergySincePlugged(i);
+	char txt[65]; mb_getAscii(i, 17, 32, txt);
+	char logStr[129]; jsonEscape(logStr, txt, sizeof(logStr));
+
+	uint16_t len = 0;
+	jsonAppend(buf, &len, PSTR("%s{\"busId\":%d,\"version\":\"%x\",\"chgStat\":%u,\"currL1\":%u,\"currL2\":%u,\"currL3\":%u,\"pcbTemp\":%u,"
+		"\"voltL1\":%u,\"voltL2\":%u,\"voltL3\":%u,\"extLock\":%u,\"power\":%u,\"energyP\":%lu.%03lu,\"energyI\":%lu.%03lu,\"energyC\":%lu.%03lu,"
+		"\"currMax\":%u,\"currMin\":%u,\"logStr\":\"%s\",\"wdTmOut\":%u,\"standby\":%u,\"remLock\":%u,\"currLim\":%u,\"currFs\":%u,"
+		"\"lmReq\":%u,\"lmLim\":%u,\"resCode\":\"%x\",\"failCnt\":%u}"),
+		first ? "" : ",", i+1, content[i][0], content[i][1], content[i][2], content[i][3], content[i][4], content[i][5],
+		content[i][6], content[i][7], content[i][8], content[i][9], content[i][10],
+		(unsigned long)(energyP / 1000), (unsigned long)(energyP % 1000),
+		(unsigned long)(energyI / 1000), (unsigned long)(energyI % 1000),
+		(unsigned long)(energyC / 1000), (unsigned long)(energyC % 1000),
+		content[i][15], content[i][16], logStr, content[i][49], content[i][50], content[i][51], content[i][53], content[i][54],
+		lm_getLastRequest(i), lm_getWbLimit(i), modbusResultCode[i], mb_getFailureCnt(i));
+	return(len);
+}
+
+
+static uint16_t jsonTrailer(char *buf) {
+	uint16_t len = 0;
+	jsonAppend(buf, &len, PSTR("],\"modbus\":{\"state\":{\"lastTm\":%lu,\"millis\":%lu}"),
+		(unsigned long)modbusLastTime, (unsigned long)millis());
+	if (cfgModbusGWActive == 2) {
+		jsonAppend(buf, &len, PSTR(",\"bus\":{\"wbPoll\":%lu,\"wbWrite\":%lu,\"gwLive\":%lu,\"gwBack\":%lu}"),
+			(unsigned long)mb_busTime(MB_BUS_WB_POLL), (unsigned long)mb_busTime(MB_BUS_WB_WRITE),
+			(unsigned long)mb_busTime(MB_BUS_GW_LIVE), (unsigned long)mb_busTime(MB_BUS_GW_BACKGROUND));
+	}
+	int qrssi = WiFi.RSSI();
+	jsonAppend(buf, &len, PSTR("},\"rfid\":{\"enabled\":%s,\"release\":%s,\"lastId\":\"%s\"},\"pv\":{\"mode\":%d,\"watt\":%ld},"
+		"\"wifi\":{\"mac\":\"%s\",\"rssi\":%d,\"signal\":%d,\"channel\":%d}}"),
+		rfid_getEnabled() ? "true" : "false", rfid_getReleased() ? "true" : "false", rfid_getLastID(), pv_getMode(), (long)pv_getWatt(),
+		WiFi.macAddress().c_str(), qrssi, getSignalQuality(qrssi), WiFi.channel());
+	return(len);
+}
+
+
+static size_t jsonFill(jsonStream_t *s, uint8_t *buffer, size_t maxLen) {
+	// called by the chunked response: render the next part only, when the previous one is sent completely
+	size_t len = 0;
+	while (len < maxLen) {
+		if (s->pos >= s->len) {
+			uint8_t boxCnt = s->to - s->from;
+			if (s->part == 0) {
+				s->len = jsonHeader(s->buf, s->from);
+			} else if (s->part <= boxCnt) {
+				s->len = jsonBox(s->buf, s->from + s->part - 1, s->part == 1);
+			} else if (s->part == boxCnt + 1) {
+				s->len = jsonTrailer(s->buf);
+			} else {
+				break;  // everything sent
+			}
+			s->pos = 0;
+			s->part++;
+		}
+		size_t n = min(maxLen - len, (size_t)(s->len - s->pos));
+		memcpy(&buffer[len], &s->buf[s->pos], n);
+		len    += n;
+		s->pos += n;
+	}
+	return(len);
+}
+
+typedef struct {
+	pvQuery_t q;
+	uint16_t  len;                 // length of the current line in buf
+	uint16_t  pos;                 // bytes of the current line already sent
+	char      buf[64];
+} pvStream_t;
+
+
+static size_t pvFill(pvStream_t *s, uint8_t *buffer, size_t maxLen) {
+	// called by the chunked response: one line (= one point of the chart) after the other
+	size_t len = 0;
+	while (len < maxLen) {
+		if (s->pos >= s->len) {
+			s->len = pvLog_queryNext(&s->q, s->buf, sizeof(s->buf));
+			s->pos = 0;
+			if (s->len == 0) {
+				break;  // everything sent
+			}
+		}
+		size_t n = min(maxLen - len, (size_t)(s->len - s->pos));
+		memcpy(&buffer[len], &s->buf[s->pos], n);
+		len    += n;
+		s->pos += n;
+	}
+	return(len);
+}
+
+
+static uint32_t getVersion() {
+	// version of the state shown by /json, /status and /pv: incremented, when boxes, load management, pv or rfid changed
+	uint32_t sum = mb_getVersionAll();
+	sum = sum * 31 + pv_getMode();
+	sum = sum * 31 + (uint32_t)pv_getWatt();
+	sum = sum * 31 + rfid_getReleased();
+	for (uint8_t i = 0; i < cfgCntWb; i++) {
+		sum = sum * 31 + ((uint16_t)lm_getLastRequest(i) << 8 | lm_getWbLimit(i));
+	}
+	if (sum != stateSum) {
+		stateSum = sum;
+		stateVer++;
+	}
+	return(stateVer);
+}
+
+
+static boolean etagMatch(AsyncWebServerRequest *request, const char *etag) {
+	AsyncWebHeader *h = request->getHeader(F("If-None-Match"));
+	return(h != NULL && h->value() == etag);
+}
+
+
+static void sendCached(AsyncWebServerRequest *request, uint8_t key, String (*render)(uint8_t key)) {
+	// serve the response from the cache, render it only when the state changed or the entry is too old
+	uint32_t ver = getVersion();
+	webCache_t *c = NULL;
+	for (uint8_t i = 0; i < WEB_CACHE_CNT && c == NULL; i++) {
+		if (cache[i].used && cache[i].key == key) {
+			c = &cache[i];
+		}
+	}
+	if (c == NULL) {
+		// replace a free or the oldest entry
+		c = &cache[0];
+		for (uint8_t i = 1; i < WEB_CACHE_CNT && c->used; i++) {
+			if (!cache[i].used || millis() - cache[i].time > millis() - c->time) {
+				c = &cache[i];
+			}
+		}
+		c->used = false;
+	}
+	if (!c->used || c->ver != ver || millis() - c->time > WEB_CACHE_TTL) {
+		c->used = true;
+		c->key  = key;
+		c->ver  = ver;
+		c->time = millis();
+		c->etag = ++cacheEtag;
+		c->body = render(key);
+	}
+
+	char etag[20];
+	snprintf_P(etag, sizeof(etag), PSTR("\"%lx-%lx\""), (unsigned long)bootId, (unsigned long)c->etag);
+	AsyncWebServerResponse *response;
+	if (etagMatch(request, etag)) {
+		response = request->beginResponse(304);
+	} else {
+		response = request->beginResponse(200, F("application/json"), c->body);
+	}
+	response->addHeader(F("ETag"), etag);
+	response->addHeader(F("Cache-Control"), F("no-cache"));
+	request->send(response);
+}
+
+static void sendJson(AsyncWebServerRequest *request, uint8_t from, uint8_t to) {
+	// weak ETag: timestamps and rssi may differ, but the state is the same
+	uint32_t ver = getVersion();
+	char etag[32];
+	snprintf_P(etag, sizeof(etag), PSTR("W/\"%lx.%lx.%u.%u\""), (unsigned long)bootId, (unsigned long)ver, from, to);
+	AsyncWebServerResponse *response;
+	if (etagMatch(request, etag)) {
+		response = request->beginResponse(304);
+	} else {
+		// provide the complete content, rendered box by box into a chunked response (constant RAM for any number of boxes)
+		std::shared_ptr<jsonStream_t> stream = std::make_shared<jsonStream_t>();
+		stream->from = from;
+		stream->to   = to;
+		stream->part = 0;
+		stream->len  = 0;
+		stream->pos  = 0;
+		response = request->beginChunkedResponse(F("application/json"), [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+			return(jsonFill(stream.get(), buffer, maxLen));
+		});
+		response->addHeader(F("Cache-Control"), F("no-cache"));
+	}
+	response->addHeader(F("ETag"), etag);
+	response->addHeader(F("X-Version"), String(ver));   // to be used for the next /json?since=
+	request->send(response);
+}
+
+
+static boolean parkRequest(AsyncWebServerRequest *request, uint32_t since, uint8_t from, uint8_t to) {
+	// long-poll: keep the request open, webServer_loop() answers it on the next state change
+	for (uint8_t i = 0; i < WEB_POLL_CNT; i++) {
+		if (longPoll[i].request == NULL) {
+			longPoll[i].request = request;
+			longPoll[i].since   = since;
+			longPoll[i].start   = millis();
+			longPoll[i].from    = from;
+			longPoll[i].to      = to;
+			request->onDisconnect([request]() {
+				for (uint8_t j = 0; j < WEB_POLL_CNT; j++) {
+					if (longPoll[j].request == request) {
+						longPoll[j].request = NULL;
+					}
+				}
+			});
+			return(true);
+		}
+	}
+	return(false);  // no free slot, answer immediately
+}
+
+
+static void checkStateChange() {
+	uint32_t ver = getVersion();
+
+	// answer the parked long-poll requests
+	for (uint8_t i = 0; i < WEB_POLL_CNT; i++) {
+		if (longPoll[i].request != NULL && (longPoll[i].since != ver || millis() - longPoll[i].start > WEB_POLL_TIMEOUT)) {
+			AsyncWebServerRequest *request = longPoll[i].request;
+			longPoll[i].request = NULL;
+			sendJson(request, longPoll[i].from, longPoll[i].to);
+		}
+	}
+
+	// server-sent events: only the boxes and values, which changed
+	if (events.count() == 0 || (ver == eventVer && !eventFull)) {
+		return;
+	}
+	char buf[JSON_PART_LEN];
+	for (uint8_t i = 0; i < cfgCntWb; i++) {
+		uint32_t sum = mb_getVersion(i) * 31 + ((uint16_t)lm_getLastRequest(i) << 8 | lm_getWbLimit(i));
+		if (sum != eventBoxSum[i] || eventFull) {
+			eventBoxSum[i] = sum;
+			jsonBox(buf, i, true);
+			events.send(buf, "box", ver);
+		}
+	}
+	if (pv_getMode() != eventPvMode || pv_getWatt() != eventPvWatt || eventFull) {
+		eventPvMode = pv_getMode();
+		eventPvWatt = pv_getWatt();
+		snprintf_P(buf, sizeof(buf), PSTR("{\"mode\":%d,\"watt\":%ld}"), eventPvMode, (long)eventPvWatt);
+		events.send(buf, "pv", ver);
+	}
+	snprintf_P(buf, sizeof(buf), PSTR("{\"ver\":%lu}"), (unsigned long)ver);
+	events.send(buf, "state", ver);
+	eventVer  = ver;
+	eventFull = false;
+}
+
+
+static String renderStatus(uint8_t key) {
+	return(goE_getStatus(key >> 1, key & 1));
+}
+
+
+static String renderPv(uint8_t key) {
+	StaticJsonDocument<PFOX_JSON_LEN> data;
+	uint8_t id = 0;
+	data[F("box")][F("chgStat")]  = content[id][1];
+	data[F("box")][F("power")]    = content[id][10];
+	data[F("box")][F("currLim")]  = content[id][53];
+	data[F("box")][F("resCode")]  = String(modbusResultCode[id], HEX);
+	data[F("modbus")][F("millis")]  = millis();
+	data[F("pv")][F("mode")]    = pv_getMode();
+	data[F("pv")][F("watt")]    = pv_getWatt();
+	String response;
+	serializeJson(data, response);
+	return(response);
+}
+
+
 void webServer_setup() {
+	bootId = random(0x7FFFFFFF);
+
 	server.on("/heap", HTTP_GET, [](AsyncWebServerRequest *request){
 		request->send(200, F("text/plain"), String(ESP.getFreeHeap()));
 	});
@@ -137,13 +499,16 @@ void webServer_setup() {
 		uint8_t  id       = 0;
 		uint8_t  from     = 0;        // used in 'for loop'
 		uint8_t  to       = cfgCntWb; // used in 'for loop'
-		uint16_t jsonSize = (cfgCntWb+2)/3 * 2048;  // always 2048 byte for 3 wallboxes
 		// modify values
 		if (request->hasParam(F("id"))) {
-			id       = request->getParam(F("id"))->value().toInt();
+			long val = request->getParam(F("id"))->value().toInt();
+			if (val < 0 || val >= cfgCntWb) {
+				request->send(400, F("text/plain"), F("Invalid id"));
+				return;
+			}
+			id       = val;
 			from     = id;      // if id is provided, then only
-			to       = id+1;    // those values are returned (-> save RAM)
-			jsonSize = 2048;    // for one wallbox 2048 are sufficient         
+			to       = id+1;    // those values are returned
 		}
 
 		if (request->hasParam(F("wdTmOut"))) {
@@ -170,7 +535,7 @@ void webServer_setup() {
 		if (request->hasParam(F("currLim"))) {
 			uint16_t val = request->getParam(F("currLim"))->value().toInt();
 			if (val == 0 || (val >= CURR_ABS_MIN && val <= CURR_ABS_MAX)) {
-				lm_storeRequest(id, val);
+				lm_storeRequest(id, val, LM_SRC_WEB);
 			}
 		}
 		if (request->hasParam(F("currFs"))) {
@@ -189,57 +554,14 @@ void webServer_setup() {
 			pv_setWatt(request->getParam(F("pvWatt"))->value().toInt());
 		}
 
-		DynamicJsonDocument data(jsonSize);    
-		// provide the complete content
-		data[F("wbec")][F("version")] = cfgWbecVersion;
-		data[F("wbec")][F("bldDate")] = cfgBuildDate;
-		data[F("wbec")][F("timeNow")] = log_time();
-		for (int i = from; i < to; i++) {
-			data[F("box")][i][F("busId")]    = i+1;
-			data[F("box")][i][F("version")]  = String(content[i][0], HEX);
-			data[F("box")][i][F("chgStat")]  = content[i][1];
-			data[F("box")][i][F("currL1")]   = content[i][2];
-			data[F("box")][i][F("currL2")]   = content[i][3];
-			data[F("box")][i][F("currL3")]   = content[i][4];
-			data[F("box")][i][F("pcbTemp")]  = content[i][5];
-			data[F("box")][i][F("voltL1")]   = content[i][6];
-			data[F("box")][i][F("voltL2")]   = content[i][7];
-			data[F("box")][i][F("voltL3")]   = content[i][8];
-			data[F("box")][i][F("extLock")]  = content[i][9];
-			data[F("box")][i][F("power")]    = content[i][10];
-			data[F("box")][i][F("energyP")]  = (float)((uint32_t) content[i][11] << 16 | (uint32_t)content[i][12]) / 1000.0;
-			data[F("box")][i][F("energyI")]  = (float)((uint32_t) content[i][13] << 16 | (uint32_t)content[i][14]) / 1000.0;
-			data[F("box")][i][F("energyC")]  = (float)goE_getEnergySincePlugged(i) / 1000.0;
-			data[F("box")][i][F("currMax")]  = content[i][15];
-			data[F("box")][i][F("currMin")]  = content[i][16];
-			char txt[65]; mb_getAscii(i, 17, 32, txt);
-			data[F("box")][i][F("logStr")]   = txt;
-			data[F("box")][i][F("wdTmOut")]  = content[i][49];
-			data[F("box")][i][F("standby")]  = content[i][50];
-			data[F("box")][i][F("remLock")]  = content[i][51];
-			data[F("box")][i][F("currLim")]  = content[i][53];
-			data[F("box")][i][F("currFs")]   = content[i][54];
-			data[F("box")][i][F("lmReq")]    = lm_getLastRequest(i);
-			data[F("box")][i][F("lmLim")]    = lm_getWbLimit(i);
-			data[F("box")][i][F("resCode")]  = String(modbusResultCode[i], HEX);
-			data[F("box")][i][F("failCnt")]  = mb_getFailureCnt(i);
+		if (request->hasParam(F("since"))) {
+			// long-poll: wait for a state change, when the client has already the actual version
+			uint32_t since = strtoul(request->getParam(F("since"))->value().c_str(), NULL, 10);
+			if (since == getVersion() && parkRequest(request, since, from, to)) {
+				return;
+			}
 		}
-		data[F("modbus")][F("state")][F("lastTm")]  = modbusLastTime;
-		data[F("modbus")][F("state")][F("millis")]  = millis();
-		data[F("rfid")][F("enabled")]      = rfid_getEnabled();
-		data[F("rfid")][F("release")]      = rfid_getReleased();
-		data[F("rfid")][F("lastId")]       = rfid_getLastID();
-		data[F("pv")][F("mode")]           = pv_getMode();
-		data[F("pv")][F("watt")]           = pv_getWatt();
-		data[F("wifi")][F("mac")]          = WiFi.macAddress();
-		int qrssi = WiFi.RSSI();     
-		data[F("wifi")][F("rssi")]         = qrssi;
-		data[F("wifi")][F("signal")]       = getSignalQuality(qrssi);
-		data[F("wifi")][F("channel")]      = WiFi.channel();
-		String response;
-		serializeJson(data, response);
-		log(m, response);
-		request->send(200, F("application/json"), response);
+		sendJson(request, from, to);
 	});
 
 	server.on("/status", HTTP_GET, [](AsyncWebServerRequest *request) {
@@ -252,7 +574,7 @@ void webServer_setup() {
 				id = 0;
 			}
 		}
-		request->send(200, F("application/json"), goE_getStatus(id, fromApp));
+		sendCached(request, id << 1 | fromApp, renderStatus);
 	});
 
 	server.on("/mqtt", HTTP_GET, [](AsyncWebServerRequest *request) {
@@ -282,8 +604,6 @@ void webServer_setup() {
 	});
 
 	server.on("/pv", HTTP_GET, [](AsyncWebServerRequest *request) {
-		StaticJsonDocument<PFOX_JSON_LEN> data;
-		uint8_t id = 0;
 		// modify values
 		if (request->hasParam(F("pvMode"))) {
 			pvMode_t val = (pvMode_t) request->getParam(F("pvMode"))->value().toInt();
@@ -294,25 +614,66 @@ void webServer_setup() {
 		if (request->hasParam(F("pvWatt"))) {
 			pv_setWatt(request->getParam(F("pvWatt"))->value().toInt());
 		}
+		sendCached(request, WEB_CACHE_PV, renderPv);
+	});
+
+	server.on("/pvdata", HTTP_GET, [](AsyncWebServerRequest *request) {
+		// PV history for the chart, downsampled to the given number of points, default: last day, points=0: every sample (export)
+		uint32_t to     = log_unixTime();
+		uint32_t from   = to - 86400;
+		uint16_t points = 500;
+		if (request->hasParam(F("to"))) {
+			to = strtoul(request->getParam(F("to"))->value().c_str(), NULL, 10);
+		}
+		if (request->hasParam(F("from"))) {
+			from = strtoul(request->getParam(F("from"))->value().c_str(), NULL, 10);
+		}
+		if (request->hasParam(F("points"))) {
+			points = constrain(request->getParam(F("points"))->value().toInt(), 0, 2000);
+		}
+		std::shared_ptr<pvStream_t> stream = std::make_shared<pvStream_t>();
+		stream->len = 0;
+		stream->pos = 0;
+		pvLog_queryBegin(&stream->q, from, to, points);
+		AsyncWebServerResponse *response = request->beginChunkedResponse(F("text/plain"), [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+			return(pvFill(stream.get(), buffer, maxLen));
+		});
+		request->send(response);
+	});
 
-		data[F("box")][F("chgStat")]  = content[id][1];
-		data[F("box")][F("power")]    = content[id][10];
-		data[F("box")][F("currLim")]  = content[id][53];
-		data[F("box")][F("resCode")]  = String(modbusResultCode[id], HEX);
-		data[F("modbus")][F("millis")]  = millis();
-		data[F("pv")][F("mode")]    = pv_getMode();
-		data[F("pv")][F("watt")]    = pv_getWatt();
-		char response[PFOX_JSON_LEN];
-		serializeJson(data, response, PFOX_JSON_LEN);
-		request->send(200, F("application/json"), response);
+	server.on("/chargelog", HTTP_GET, [](AsyncWebServerRequest *request) {
+		uint8_t id  = 0;
+		uint8_t len = 10;
+		if (request->hasParam(F("id"))) {
+			long val = request->getParam(F("id"))->value().toInt();
+			if (val < 0 || val >= cfgCntWb) {
+				request->send(400, F("text/plain"), F("Invalid id"));
+				return;
+			}
+			id = val;
+		}
+		if (request->hasParam(F("len"))) {
+			len = constrain(request->getParam(F("len"))->value().toInt(), 0, 255);
+		}
+		request->send(200, F("application/json"), chargeLog_getJson(id, len));
 	});
 
 	server.on("/inverter", HTTP_GET, [](AsyncWebServerRequest *request){
 		request->send(200, F("application/json"), inverter_getStatus());
 	});
 
+	server.on("/gateway", HTTP_GET, [](AsyncWebServerRequest *request){
+		request->send(200, F("application/json"), gateway_getStatus());
+	});
+
 
 	// add the SPIFFSEditor, which can be opened via "/edit"
+	// server-sent events with the changed boxes and pv values
+	events.onConnect([](AsyncEventSourceClient *client) {
+		eventFull = true;
+	});
+	server.addHandler(&events);
+
 	server.addHandler(new SPIFFSEditor("" ,"" ,LittleFS));//http_username,http_password));
 
 	server.serveStatic("/", LittleFS, "/");
@@ -330,11 +691,17 @@ void webServer_setup() {
 }
 
 void webServer_loop() {
+	if (millis() - lastStateCheck >= WEB_EVT_INTERVAL) {
+		lastStateCheck = millis();
+		checkStateChange();
+	}
 	if (resetRequested || 
 		 ((cfgKnockOutTimer >= 20) && (millis() > ((uint32_t)cfgKnockOutTimer) * 60 * 1000))) {
+		pvLog_flush(true);
 		ESP.restart();
 	}
 	if (resetwifiRequested) {
+		pvLog_flush(true);
 		WiFi.disconnect(true);
 		ESP.eraseConfig();
 		ESP.restart();
@@ -1,7 +1,6 @@
 // Copyright (c) 2021 steff393, MIT license
 
 #include <Arduino.h>
-#include <ArduinoJson.h>
 #include "globalConfig.h"
 #include "goEmulator.h"
 #include "logger.h"
@@ -12,31 +11,135 @@
 #include "webSocket.h"
 #include "WebSocketsServer.h"
 
-#define CYCLE_TIME	 1000	
-#define JSON_LEN      256
+#define CYCLE_TIME	  250    // [ms] check for changes of the subscribed values
+#define FRAME_BOX_LEN 100    // max. payload per box with all fields
+#define FRAME_LEN     100    // max. payload without boxes
 
 static const uint8_t m = 10;
 
+// fields, which can be subscribed with 'fields=chgStat,power,...', the box id is always sent
+typedef enum {
+	FLD_CHGSTAT = 0,
+	FLD_POWER,
+	FLD_ENERGYI,
+	FLD_ENERGYC,
+	FLD_CURRLIM,
+	FLD_WATT,
+	FLD_PVMODE,
+	FLD_TIMENOW,
+	FLD_CNT
+} wsField_t;
+
+#define FLD_ALL    ((1 << FLD_CNT) - 1)
+
+static const char fieldName0[] PROGMEM = "chgStat";
+static const char fieldName1[] PROGMEM = "power";
+static const char fieldName2[] PROGMEM = "energyI";
+static const char fieldName3[] PROGMEM = "energyC";
+static const char fieldName4[] PROGMEM = "currLim";
+static const char fieldName5[] PROGMEM = "watt";
+static const char fieldName6[] PROGMEM = "pvMode";
+static const char fieldName7[] PROGMEM = "timeNow";
+static PGM_P const fieldName[FLD_CNT] = { fieldName0, fieldName1, fieldName2, fieldName3, fieldName4, fieldName5, fieldName6, fieldName7 };
+
+typedef struct {
+	boolean  connected;
+	boolean  pending;     // send on next check, e.g. after (re-)subscription
+	uint16_t boxMask;     // subscribed boxes, bit 0 = box 0
+	uint16_t fieldMask;   // subscribed fields, see wsField_t
+	uint8_t  hb;          // [s] heartbeat: send also without change, 0 = only on change
+	uint32_t lastSent;    // [ms]
+	uint32_t sum;         // checksum of the last sent payload (without timeNow)
+} wsClient_t;
+
 static WebSocketsServer webSocket = WebSocketsServer(81);
-static uint32_t lastCall   = 0;
-static uint8_t  id         = 0;
+static uint32_t   lastCall   = 0;
+static wsClient_t client[WEBSOCKETS_SERVER_CLIENT_MAX];
+static char      *frame      = NULL;   // shared by all clients: header space + payload, grows to the largest subscription
+static uint16_t   frameSize  = 0;
+
+
+static void append(char *buf, uint16_t size, uint16_t *len, PGM_P fmt, ...) {
+	// snprintf to the end of buf, truncated if necessary
+	va_list args;
+	va_start(args, fmt);
+	int n = vsnprintf_P(&buf[*len], size - *len, fmt, args);
+	va_end(args);
+	*len = min((uint16_t)(*len + max(n, 0)), (uint16_t)(size - 1));
+}
+
+
+static uint8_t firstBox(uint16_t boxMask) {
+	return(boxMask ? __builtin_ctz(boxMask) : 0);
+}
+
+
+static uint16_t parseBoxes(char *list) {
+	// comma-separated list of box ids, e.g. 'ids=0,2,3'
+	uint16_t mask = 0;
+	for (char *pch = strtok(list, ","); pch != NULL; pch = strtok(NULL, ",")) {
+		int i = atoi(pch);
+		if (i >= 0 && i < cfgCntWb) {
+			mask |= 1 << i;
+		}
+	}
+	return(mask);
+}
+
+
+static uint16_t parseFields(char *list) {
+	// comma-separated list of field names, e.g. 'fields=chgStat,power', empty list: all fields
+	uint16_t mask = 0;
+	for (char *pch = strtok(list, ","); pch != NULL; pch = strtok(NULL, ",")) {
+		for (uint8_t f = 0; f < FLD_CNT; f++) {
+			if (!strcmp_P(pch, fieldName[f])) {
+				mask |= 1 << f;
+			}
+		}
+	}
+	return(mask ? mask : FLD_ALL);
+}
 
 
 static void webSocketEvent(byte num, WStype_t type, uint8_t * payload, size_t length) {
-	if(type == WStype_TEXT) {
+	if (num >= WEBSOCKETS_SERVER_CLIENT_MAX) {
+		return;
+	}
+	wsClient_t *c = &client[num];
+	if (type == WStype_CONNECTED) {
+		// default: first box, all fields, only on change
+		c->connected = true;
+		c->pending   = true;
+		c->boxMask   = 1;
+		c->fieldMask = FLD_ALL;
+		c->hb        = 0;
+	} else if (type == WStype_DISCONNECTED) {
+		c->connected = false;
+	} else if(type == WStype_TEXT) {
 		LOG(m, "Payload %s", (char *)payload)
+		char *val = strchr((char *)payload, '=');
+		if (val != NULL) {
+			val++;
+		}
 		if (length >= 9 && !strncmp((char *)payload, "currLim=", 8)) {
-			char * pch;
-			pch = strtok((char *)payload, "=");
-			pch = strtok(NULL, "=");
-			lm_storeRequest(id, atoi(pch));
+			lm_storeRequest(firstBox(c->boxMask), atoi(val), LM_SRC_WEB);
 		} else if (length >= 4 && !strncmp((char *)payload, "id=", 3)) {
-			char * pch;
-			pch = strtok((char *)payload, "=");
-			pch = strtok(NULL, "=");
-			if (atoi(pch) < cfgCntWb) {
-				id = atoi(pch);
+			int i = atoi(val);
+			if (i >= 0 && i < cfgCntWb) {
+				c->boxMask = 1 << i;
+				c->pending = true;
+			}
+		} else if (length >= 5 && !strncmp((char *)payload, "ids=", 4)) {
+			uint16_t mask = parseBoxes(val);
+			if (mask) {
+				c->boxMask = mask;
+				c->pending = true;
 			}
+		} else if (length >= 7 && !strncmp((char *)payload, "fields=", 7)) {
+			c->fieldMask = parseFields(val);
+			c->pending   = true;
+		} else if (length >= 4 && !strncmp((char *)payload, "hb=", 3)) {
+			c->hb = atoi(val);
 		} else if (strstr_P((char *)payload, PSTR("PV_OFF"))) {
 			pv_setMode(PV_OFF);
 		} else if (strstr_P((char *)payload, PSTR("PV_ACTIVE"))) {
@@ -44,7 +147,81 @@ static void webSocketEvent(byte num, WStype_t type, uint8_t * payload, size_t le
 		} else if (strstr_P((char *)payload, PSTR("PV_MIN_PV"))) {
 			pv_setMode(PV_MIN_PV);
 		}
-	} 
+	}
+}
+
+
+static void encodeBox(char *buf, uint16_t size, uint16_t *len, uint8_t id, uint16_t fields) {
+	append(buf, size, len, PSTR("\"id\":%d"), id);
+	if (fields & 1 << FLD_CHGSTAT) {
+		append(buf, size, len, PSTR(",\"chgStat\":%u"), content[id][1]);
+	}
+	if (fields & 1 << FLD_POWER) {
+		append(buf, size, len, PSTR(",\"power\":%u"), content[id][10]);
+	}
+	if (fields & 1 << FLD_ENERGYI) {
+		uint32_t energyI = (uint32_t) content[id][13] << 16 | (uint32_t)content[id][14];
+		append(buf, size, len, PSTR(",\"energyI\":%lu.%03lu"), (unsigned long)(energyI / 1000), (unsigned long)(energyI % 1000));
+	}
+	if (fields & 1 << FLD_ENERGYC) {
+		uint32_t energyC = goE_getEnergySincePlugged(id);
+		append(buf, size, len, PSTR(",\"energyC\":%lu.%03lu"), (unsigned long)(energyC / 1000), (unsigned long)(energyC % 1000));
+	}
+	if (fields & 1 << FLD_CURRLIM) {
+		append(buf, size, len, PSTR(",\"currLim\":%u.%u"), content[id][53] / 10, content[id][53] % 10);
+	}
+}
+
+
+static uint16_t encode(char *buf, uint16_t size, uint16_t boxMask, uint16_t fields, uint32_t *sum) {
+	// one box: flat object as before, several boxes: array 'box' and the global values
+	uint16_t len = 0;
+	if ((boxMask & (boxMask - 1)) == 0) {
+		append(buf, size, &len, PSTR("{"));
+		encodeBox(buf, size, &len, firstBox(boxMask), fields);
+	} else {
+		append(buf, size, &len, PSTR("{\"box\":["));
+		for (uint8_t i = 0; i < cfgCntWb; i++) {
+			if (boxMask & 1 << i) {
+				append(buf, size, &len, buf[len-1] == '[' ? PSTR("{") : PSTR(",{"));
+				encodeBox(buf, size, &len, i, fields);
+				append(buf, size, &len, PSTR("}"));
+			}
+		}
+		append(buf, size, &len, PSTR("]"));
+	}
+	if (fields & 1 << FLD_WATT) {
+		append(buf, size, &len, PSTR(",\"watt\":%ld"), (long)pv_getWatt());
+	}
+	if (fields & 1 << FLD_PVMODE) {
+		append(buf, size, &len, PSTR(",\"pvMode\":%d"), pv_getMode());
+	}
+	// the time changes always, so it's not part of the checksum
+	uint32_t s = 0;
+	for (uint16_t i = 0; i < len; i++) {
+		s = s * 31 + buf[i];
+	}
+	*sum = s;
+	if (fields & 1 << FLD_TIMENOW) {
+		append(buf, size, &len, PSTR(",\"timeNow\":\"%s\""), log_time().c_str());
+	}
+	append(buf, size, &len, PSTR("}"));
+	return(len);
+}
+
+
+static boolean frameReserve(uint16_t boxMask) {
+	uint16_t size = WEBSOCKETS_MAX_HEADER_SIZE + FRAME_LEN + __builtin_popcount(boxMask) * FRAME_BOX_LEN;
+	if (size > frameSize) {
+		char *buf = (char *)realloc(frame, size);
+		if (buf == NULL) {
+			LOGW(m, "No memory for %d byte", size);
+			return(false);
+		}
+		frame     = buf;
+		frameSize = size;
+	}
+	return(true);
 }
 
 
@@ -62,17 +239,33 @@ void webSocket_loop() {
 	}
 	lastCall = millis();
 
-	StaticJsonDocument<JSON_LEN> data;
-	data[F("id")]       = id;
-	data[F("chgStat")]  = content[id][1];
-	data[F("power")]    = content[id][10];
-	data[F("energyI")]  = (float)((uint32_t) content[id][13] << 16 | (uint32_t)content[id][14]) / 1000.0;
-	data[F("energyC")]  = (float)goE_getEnergySincePlugged(id) / 1000.0;
-	data[F("currLim")]  = (float)content[id][53]/10.0;
-	data[F("watt")]     = pv_getWatt();
-	data[F("pvMode")]   = pv_getMode();
-	data[F("timeNow")]  = log_time();
-	char response[JSON_LEN];
-	serializeJson(data, response, JSON_LEN);
-	webSocket.broadcastTXT(response);
+	// encode the payload once per distinct subscription into the shared frame and send it to all clients with this subscription
+	boolean done[WEBSOCKETS_SERVER_CLIENT_MAX] = { false };
+	for (uint8_t i = 0; i < WEBSOCKETS_SERVER_CLIENT_MAX; i++) {
+		if (!client[i].connected || done[i]) {
+			continue;
+		}
+		uint32_t sum = 0;
+		uint16_t len = 0;
+		for (uint8_t j = i; j < WEBSOCKETS_SERVER_CLIENT_MAX; j++) {
+			wsClient_t *c = &client[j];
+			if (!c->connected || c->boxMask != client[i].boxMask || c->fieldMask != client[i].fieldMask) {
+				continue;
+			}
+			done[j] = true;
+			if (len == 0) {
+				if (!frameReserve(client[i].boxMask)) {
+					break;
+				}
+				len = encode(&frame[WEBSOCKETS_MAX_HEADER_SIZE], frameSize - WEBSOCKETS_MAX_HEADER_SIZE, client[i].boxMask, client[i].fieldMask, &sum);
+			}
+			if (c->pending || c->sum != sum || (c->hb && millis() - c->lastSent >= (uint32_t)c->hb * 1000)) {
+				c->pending  = false;
+				c->sum      = sum;
+				c->lastSent = millis();
+				// the library writes the header in front of the payload, so the frame is neither copied nor allocated per client
+				webSocket.sendTXT(j, (uint8_t *)frame, len, true);
+			}
+		}
+	}
 }
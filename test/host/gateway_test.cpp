@@ -0,0 +1,231 @@
+// Copyright (c) 2023 steff393, MIT license
+// Gateway: queue of the TCP requests in front of the RTU bus, merging of overlapping reads
+
+#include "gateway.cpp"
+#include "host.h"
+
+#define IP_A 0x0100000A        // 10.0.0.1
+#define IP_B 0x0200000A        // 10.0.0.2
+
+static boolean busFree = true;
+
+// the wallbox communication and the Modbus TCP server are not part of this test
+boolean mb_busFree()                   { return(busFree); }
+void mb_busAcquire(mbBus_t cls)        {}
+ModbusRTU* mb_getBus()                 { return(&rtu); }
+Modbus::ResultCode mbs_request(ModbusTCP *tcp, uint8_t *data, uint8_t len, Modbus::frame_arg_t *src) {
+	return(Modbus::EX_PASSTHROUGH);
+}
+
+
+static std::vector<uint8_t> readPdu(uint8_t fc, uint16_t addr, uint16_t cnt) {
+	return(std::vector<uint8_t>({ fc, (uint8_t)(addr >> 8), (uint8_t)addr, (uint8_t)(cnt >> 8), (uint8_t)cnt }));
+}
+
+
+static std::vector<uint8_t> readResp(uint8_t fc, uint16_t addr, uint16_t cnt) {
+	// register value = address
+	std::vector<uint8_t> r = { fc, (uint8_t)(cnt * 2) };
+	for (uint16_t a = addr; a < addr + cnt; a++) {
+		r.push_back(a >> 8);
+		r.push_back(a & 0xFF);
+	}
+	return(r);
+}
+
+
+static const ModbusTCP::resp_t* respOf(uint16_t transId) {
+	for (auto &r : tcp.resp) {
+		if (r.transId == transId) {
+			return(&r);
+		}
+	}
+	return(nullptr);
+}
+
+
+static void reset() {
+	for (uint8_t i = 0; i < GW_QUEUE_SIZE; i++) {
+		queueFree(i);
+	}
+	memset(cache, 0, sizeof(cache));
+	lastIp = 0;
+	tcp.resp.clear();
+	rtu.sl = 0;
+	rtu.sent = 0;
+	busFree = true;
+	hostTime += 10000;
+}
+
+
+static void testFairness() {
+	// A sends two requests, then B one: B is served before the second one of A
+	reset();
+	busFree = false;
+	tcp.request(IP_A, 1, 1, readPdu(0x03, 0, 1));
+	tcp.request(IP_A, 2, 1, readPdu(0x03, 10, 1));
+	tcp.request(IP_B, 3, 1, readPdu(0x03, 20, 1));
+	gateway_loop();
+	CHECK(rtu.sent == 0);          // bus busy: nothing is sent
+	busFree = true;
+	std::vector<uint16_t> order;
+	for (uint8_t n = 0; n < 3; n++) {
+		gateway_loop();
+		CHECK(rtu.sl == 1);
+		order.push_back(getWord(&rtu.pdu[1]));
+		rtu.reply(readResp(0x03, getWord(&rtu.pdu[1]), 1));
+	}
+	CHECK(order == std::vector<uint16_t>({ 0, 20, 10 }));
+	CHECK(tcp.resp.size() == 3);
+	CHECK(respOf(3) && respOf(3)->ip == IP_B && respOf(3)->pdu == readResp(0x03, 20, 1));
+}
+
+
+static void testBusy() {
+	// max. GW_CLIENT_MAX requests per client, then 'slave device busy'
+	reset();
+	busFree = false;
+	for (uint8_t n = 0; n <= GW_CLIENT_MAX; n++) {
+		tcp.request(IP_A, 10 + n, 1, readPdu(0x03, n, 1));
+	}
+	CHECK(tcp.resp.size() == 1);
+	CHECK(respOf(10 + GW_CLIENT_MAX) && respOf(10 + GW_CLIENT_MAX)->pdu == std::vector<uint8_t>({ 0x83, Modbus::EX_SLAVE_DEVICE_BUSY }));
+	CHECK(queueCount(IP_A) == GW_CLIENT_MAX);
+}
+
+
+static void testWait() {
+	// a request, which waited longer than GW_MAX_WAIT, gets an exception instead of no response
+	reset();
+	busFree = false;
+	tcp.request(IP_A, 20, 1, readPdu(0x03, 0, 1));
+	hostTime += GW_MAX_WAIT + 1;
+	gateway_loop();
+	CHECK(respOf(20) && respOf(20)->pdu == std::vector<uint8_t>({ 0x83, Modbus::EX_DEVICE_FAILED_TO_RESPOND }));
+	CHECK(queueCount(0) == 0);
+}
+
+
+static void testTimeout() {
+	// no response on the RTU side
+	reset();
+	tcp.request(IP_A, 30, 1, readPdu(0x04, 0, 2));
+	gateway_loop();
+	rtu.timeout();
+	CHECK(respOf(30) && respOf(30)->pdu == std::vector<uint8_t>({ 0x84, Modbus::EX_DEVICE_FAILED_TO_RESPOND }));
+	CHECK(queueCount(0) == 0 && active == 0);
+}
+
+
+static void testBroadcast() {
+	// no response is expected from the slaves, the client gets 'acknowledge' at once
+	reset();
+	tcp.request(IP_A, 40, 0, { 0x06, 0x00, 0x10, 0x00, 0x01 });
+	gateway_loop();
+	CHECK(rtu.sent == 1 && rtu.pdu == std::vector<uint8_t>({ 0x06, 0x00, 0x10, 0x00, 0x01 }));
+	CHECK(respOf(40) && respOf(40)->pdu == std::vector<uint8_t>({ 0x86, Modbus::EX_ACKNOWLEDGE }));
+	CHECK(queueCount(0) == 0);
+}
+
+
+static void testMerge() {
+	// overlapping and adjacent reads of the same unit and function code are sent as one read
+	reset();
+	cfgGwMaxBlock = GW_BLOCK_MAX;
+	busFree = false;
+	tcp.request(IP_A, 50, 1, readPdu(0x03, 100, 10));   // 100..109
+	tcp.request(IP_B, 51, 1, readPdu(0x03, 105, 15));   // 105..119, overlapping
+	tcp.request(IP_A, 52, 1, readPdu(0x03, 120, 5));    // 120..124, adjacent
+	tcp.request(IP_B, 53, 1, readPdu(0x04, 100, 1));    // other function code
+	tcp.request(IP_A, 54, 2, readPdu(0x03, 100, 1));    // other unit
+	busFree = true;
+	gateway_loop();
+	CHECK(rtu.sent == 1 && rtu.pdu == readPdu(0x03, 100, 25));
+	rtu.reply(readResp(0x03, 100, 25));
+	CHECK(tcp.resp.size() == 3);
+	CHECK(respOf(50) && respOf(50)->ip == IP_A && respOf(50)->pdu == readResp(0x03, 100, 10));
+	CHECK(respOf(51) && respOf(51)->ip == IP_B && respOf(51)->pdu == readResp(0x03, 105, 15));
+	CHECK(respOf(52) && respOf(52)->ip == IP_A && respOf(52)->pdu == readResp(0x03, 120, 5));
+	CHECK(queueCount(0) == 2);
+	gateway_loop();                // B is next (fairness)
+	CHECK(rtu.pdu == readPdu(0x04, 100, 1));
+	rtu.reply(readResp(0x04, 100, 1));
+	gateway_loop();
+	CHECK(rtu.sl == 2 && rtu.pdu == readPdu(0x03, 100, 1));
+	rtu.reply(readResp(0x03, 100, 1));
+	CHECK(tcp.resp.size() == 5 && queueCount(0) == 0);
+}
+
+
+static void testMergeLimit() {
+	// the merged read must not exceed the block size of the unit
+	reset();
+	cfgGwMaxBlock = 10;
+	busFree = false;
+	tcp.request(IP_A, 60, 1, readPdu(0x03, 0, 8));
+	tcp.request(IP_B, 61, 1, readPdu(0x03, 8, 2));      // 0..9: fits
+	tcp.request(IP_B, 62, 1, readPdu(0x03, 10, 1));     // 0..10: too large
+	busFree = true;
+	gateway_loop();
+	CHECK(rtu.pdu == readPdu(0x03, 0, 10));
+	rtu.reply(readResp(0x03, 0, 10));
+	CHECK(tcp.resp.size() == 2 && queueCount(0) == 1);
+	gateway_loop();
+	CHECK(rtu.pdu == readPdu(0x03, 10, 1));
+	rtu.reply(readResp(0x03, 10, 1));
+
+	// more than the Modbus limit can't be merged or answered
+	tcp.request(IP_A, 63, 1, readPdu(0x03, 0, GW_BLOCK_MAX + 1));
+	CHECK(respOf(63) && respOf(63)->pdu == std::vector<uint8_t>({ 0x83, Modbus::EX_ILLEGAL_VALUE }));
+}
+
+
+static void testMergeMax() {
+	// the largest merged response (125 registers) is split without overflow
+	reset();
+	cfgGwMaxBlock = GW_BLOCK_MAX;
+	busFree = false;
+	tcp.request(IP_A, 80, 1, readPdu(0x04, 1000, 100));
+	tcp.request(IP_B, 81, 1, readPdu(0x04, 1100, GW_BLOCK_MAX - 100));
+	busFree = true;
+	gateway_loop();
+	CHECK(rtu.pdu == readPdu(0x04, 1000, GW_BLOCK_MAX));
+	rtu.reply(readResp(0x04, 1000, GW_BLOCK_MAX));
+	CHECK(respOf(80) && respOf(80)->pdu == readResp(0x04, 1000, 100));
+	CHECK(respOf(81) && respOf(81)->pdu == readResp(0x04, 1100, GW_BLOCK_MAX - 100));
+}
+
+
+static void testMergeException() {
+	// an exception of the slave is forwarded to all merged requests
+	reset();
+	cfgGwMaxBlock = GW_BLOCK_MAX;
+	busFree = false;
+	tcp.request(IP_A, 70, 1, readPdu(0x03, 0, 4));
+	tcp.request(IP_B, 71, 1, readPdu(0x03, 2, 4));
+	busFree = true;
+	gateway_loop();
+	CHECK(rtu.pdu == readPdu(0x03, 0, 6));
+	rtu.reply({ 0x83, Modbus::EX_ILLEGAL_ADDRESS });
+	CHECK(respOf(70) && respOf(70)->pdu == std::vector<uint8_t>({ 0x83, Modbus::EX_ILLEGAL_ADDRESS }));
+	CHECK(respOf(71) && respOf(71)->pdu == std::vector<uint8_t>({ 0x83, Modbus::EX_ILLEGAL_ADDRESS }));
+	CHECK(queueCount(0) == 0);
+}
+
+
+int main() {
+	cfgModbusGWActive = 1;
+	cfgGwCacheTtl     = 0;
+	cfgGwMaxBlock     = 0;
+	gateway_setup();
+	testFairness();
+	testBusy();
+	testWait();
+	testTimeout();
+	testBroadcast();
+	testMerge();
+	testMergeLimit();
+	testMergeMax();
+	testMergeException();
+	return(hostResult());
+}
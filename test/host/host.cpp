@@ -0,0 +1,215 @@
+// Copyright (c) 2023 steff393, MIT license
+// Host tests: Arduino core, logger and LittleFS in RAM
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "host.h"
+
+uint32_t hostTime     = 0;
+uint32_t hostUnixTime = 1700000000UL;
+boolean  hostLog      = false;
+std::map<std::string, std::vector<uint8_t>> hostFs;
+std::map<std::string, uint32_t> hostFsRewrites;
+
+static int failed = 0;
+
+HardwareSerial Serial;
+EspClass       ESP;
+FS             LittleFS;
+
+
+void hostCheck(bool ok, const char *cond, const char *file, int line) {
+	if (!ok) {
+		printf("%s:%d: check failed: %s\n", file, line, cond);
+		failed++;
+	}
+}
+
+
+int hostResult() {
+	return(failed ? 1 : 0);
+}
+
+
+unsigned long millis()        { return(hostTime); }
+unsigned long micros()        { return(hostTime * 1000UL); }
+void delay(unsigned long ms)  { hostTime += ms; }
+void yield()                  {}
+long random(long max)         { return(max ? rand() % max : 0); }
+long random(long min, long max) { return(min + random(max - min)); }
+
+
+size_t strlcpy(char *dst, const char *src, size_t size) {
+	size_t len = strlen(src);
+	if (size) {
+		size_t n = len < size - 1 ? len : size - 1;
+		memcpy(dst, src, n);
+		dst[n] = '\0';
+	}
+	return(len);
+}
+
+
+void log(uint8_t module, const char *msg, boolean newLine, uint8_t level) {
+	if (hostLog) {
+		printf("%s%s", msg, newLine ? "\n" : "");
+	}
+}
+
+
+void log(uint8_t module, String msg, boolean newLine, uint8_t level) {
+	log(module, msg.c_str(), newLine, level);
+}
+
+
+uint32_t log_unixTime() {
+	return(hostUnixTime);
+}
+
+
+// LittleFS: the files are kept by name, a File refers to its name by index
+static std::vector<std::string> names;
+
+static int nameId(const std::string &name) {
+	for (size_t i = 0; i < names.size(); i++) {
+		if (names[i] == name) {
+			return(i);
+		}
+	}
+	names.push_back(name);
+	return(names.size() - 1);
+}
+
+
+File::operator bool() const {
+	return(id >= 0 && hostFs.count(names[id]));
+}
+
+
+size_t File::size() {
+	return(*this ? hostFs[names[id]].size() : 0);
+}
+
+
+bool File::seek(uint32_t p, int mode) {
+	pos = (mode == SeekEnd) ? size() - p : p;
+	return(*this && pos <= size());
+}
+
+
+size_t File::read(uint8_t *buf, size_t size) {
+	if (!*this) {
+		return(0);
+	}
+	std::vector<uint8_t> &data = hostFs[names[id]];
+	size_t n = 0;
+	while (n < size && pos < data.size()) {
+		buf[n++] = data[pos++];
+	}
+	return(n);
+}
+
+
+int File::read() {
+	uint8_t c;
+	return(read(&c, 1) == 1 ? c : -1);
+}
+
+
+int File::available() {
+	return(*this ? size() - pos : 0);
+}
+
+
+size_t File::write(const uint8_t *buf, size_t size) {
+	if (!*this) {
+		return(0);
+	}
+	std::vector<uint8_t> &data = hostFs[names[id]];
+	if (pos < data.size()) {
+		hostFsRewrites[names[id]]++;
+	}
+	if (data.size() < pos + size) {
+		data.resize(pos + size);
+	}
+	memcpy(&data[pos], buf, size);
+	pos += size;
+	return(size);
+}
+
+
+File FS::open(const char *path, const char *mode) {
+	File f;
+	if (mode[0] == 'r' && !hostFs.count(path)) {
+		return(f);
+	}
+	if (mode[0] == 'w') {
+		hostFs[path].clear();
+	}
+	f.id  = nameId(path);
+	f.pos = (mode[0] == 'a') ? hostFs[path].size() : 0;
+	return(f);
+}
+
+
+bool FS::exists(const char *path) {
+	return(hostFs.count(path) > 0);
+}
+
+
+bool FS::remove(const char *path) {
+	return(hostFs.erase(path) > 0);
+}
+
+
+bool FS::rename(const char *from, const char *to) {
+	if (!hostFs.count(from)) {
+		return(false);
+	}
+	hostFs[to] = hostFs[from];
+	hostFs.erase(from);
+	return(true);
+}
+
+
+bool FS::info(FSInfo &info) {
+	info.totalBytes = 2000000;
+	info.usedBytes  = 0;
+	for (auto &file : hostFs) {
+		info.usedBytes += file.second.size();
+	}
+	return(true);
+}
+
+
+Dir FS::openDir(const char *path) {
+	Dir dir;
+	dir.path = std::string(path) + "/";
+	return(dir);
+}
+
+
+static std::vector<std::string> dirList(const std::string &path) {
+	std::vector<std::string> list;
+	for (auto &file : hostFs) {
+		if (file.first.compare(0, path.size(), path) == 0) {
+			list.push_back(file.first);
+		}
+	}
+	return(list);
+}
+
+
+bool Dir::next() {
+	return(++idx < (int)dirList(path).size());
+}
+
+
+String Dir::fileName() {
+	return(String(dirList(path)[idx].substr(path.size()).c_str()));
+}
+
+
+size_t Dir::fileSize() {
+	return(hostFs[dirList(path)[idx]].size());
+}
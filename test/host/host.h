@@ -0,0 +1,22 @@
+// Copyright (c) 2023 steff393, MIT license
+// Host tests: state of the simulated environment, shared by all tests
+#ifndef HOST_H
+#define HOST_H
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include <vector>
+
+extern uint32_t hostTime;          // [ms] returned by millis(), advanced by the tests
+extern uint32_t hostUnixTime;      // returned by log_unixTime()
+extern boolean  hostLog;           // print the log of the modules
+extern std::map<std::string, std::vector<uint8_t>> hostFs;   // files of LittleFS
+extern std::map<std::string, uint32_t> hostFsRewrites;       // writes before the end of a file (LittleFS copies the rest of the file)
+
+// failed checks are reported, the test continues
+#define CHECK(cond)  hostCheck((cond), #cond, __FILE__, __LINE__)
+extern void hostCheck(bool ok, const char *cond, const char *file, int line);
+extern int  hostResult();          // exit code of the test
+
+#endif /* HOST_H */
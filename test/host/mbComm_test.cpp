@@ -0,0 +1,90 @@
+// Copyright (c) 2023 steff393, MIT license
+// Wallbox communication: confirmation of the current requests by the load manager, validity of the boxes
+
+#include "mbComm.cpp"
+#include "loadManager.cpp"
+#include "host.h"
+
+static uint16_t boxCurr  = 0;          // current limit, which the simulated box reports
+static uint16_t boxNext  = 0;          // ... and which it applies at boxApply
+static uint32_t boxApply = 0;
+
+// phase switching is not part of this test
+void    pc_backupRequest(uint16_t val) {}
+boolean pc_switchInProgress()         { return(false); }
+
+
+static uint16_t boxRegs(uint8_t slave, uint16_t reg) {
+	if (reg == REG_CURR_LIMIT) {
+		if (boxApply && hostTime >= boxApply) {
+			boxCurr  = boxNext;
+			boxApply = 0;
+		}
+		return(boxCurr);
+	}
+	return(reg == 4 ? 0x0108 : 0);     // firmware version, all other registers 0
+}
+
+
+static void run(uint32_t ms) {
+	for (uint32_t end = hostTime + ms; hostTime < end; hostTime += 50) {
+		lm_loop();
+		mb_loop();
+	}
+}
+
+
+static void testValid() {
+	CHECK(!mb_isValid(0) && !mb_isValid(1));
+	run(50);                           // first poll message of box 0
+	CHECK( mb_isValid(0) && !mb_isValid(1));
+	run(5000);
+	CHECK( mb_isValid(0) &&  mb_isValid(1));
+}
+
+
+static void testReadBack() {
+	// the box applies the value at once: the read back after the write confirms it
+	uint8_t  val, src;
+	uint32_t lat;
+	uint16_t seq = lm_getAck(0, &val, &lat, &src);
+	boxNext  = 100;
+	boxApply = hostTime;
+	lm_storeRequest(0, 100, LM_SRC_WEB);
+	run(200);
+	CHECK(lm_getAck(0, &val, &lat, &src) == seq + 1);
+	CHECK(val == 100 && src == LM_SRC_WEB && lat <= 200);
+}
+
+
+static void testCyclicRead() {
+	// the box applies the value only after the read back: the next cyclic read confirms it
+	uint8_t  val, src;
+	uint32_t lat;
+	uint16_t seq = lm_getAck(1, &val, &lat, &src);
+	boxNext  = 80;
+	boxApply = hostTime + 1000;
+	lm_storeRequest(1, 80, LM_SRC_EVCC);
+	run(500);
+	CHECK(lm_getAck(1, &val, &lat, &src) == seq);                   // read back still returns the old value
+	run(cfgMbCycleTime * 1000 + 1000);
+	CHECK(lm_getAck(1, &val, &lat, &src) == seq + 1);
+	CHECK(val == 80 && src == LM_SRC_EVCC && lat >= 1000);
+	CHECK(lm_getLatency(LM_SRC_EVCC)->timeout == 0);
+}
+
+
+int main() {
+	cfgCntWb          = 2;
+	cfgMbCycleTime    = 1;
+	cfgMbDelay        = 0;
+	cfgModbusGWActive = 0;
+	cfgTotalCurrMax   = 0;
+	mb.regs = boxRegs;
+	mb_setup();
+	lm_setup();
+	testValid();
+	testReadBack();
+	testCyclicRead();
+	return(hostResult());
+}
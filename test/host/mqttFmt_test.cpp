@@ -0,0 +1,107 @@
+// Copyright (c) 2023 steff393, MIT license
+// MQTT: value formatting and topic prefixes, compared with the snprintf() path they replaced.
+// The timings are measured on the PC, so only the ratio between both paths is meaningful.
+
+#include "mqtt.cpp"
+#include "host.h"
+#include <chrono>
+
+#define BENCH_CNT 2000000UL
+
+static volatile uint32_t sink;   // keeps the results alive
+
+
+static std::string str(const char *buf, uint8_t len) {
+	return(std::string(buf, len));
+}
+
+
+static double nsPerOp(std::chrono::steady_clock::time_point start) {
+	return(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_CNT);
+}
+
+
+static void testFormat() {
+	char buf[20];
+	CHECK(str(buf, fmtUint(buf, 0))            == "0");
+	CHECK(str(buf, fmtUint(buf, 4294967295UL)) == "4294967295");
+	CHECK(str(buf, fmtInt(buf, -1234))         == "-1234");
+	CHECK(str(buf, fmtInt(buf, INT32_MIN))     == "-2147483648");
+	CHECK(str(buf, fmtFix(buf, 1234, 1))       == "123.4");
+	CHECK(str(buf, fmtFix(buf, 0, 1))          == "0.0");
+	CHECK(str(buf, fmtFix(buf, 5, 3))          == "0.005");
+	CHECK(str(buf, fmtFix(buf, 4294967295UL, 3)) == "4294967.295");
+	CHECK(str(buf, fmtHex(buf, 0xE4))          == "e4");
+
+	// same output as the former snprintf() with float, e.g. kWhCounter and APhase
+	char ref[20];
+	for (uint32_t val = 0; val < 200000; val += 7) {
+		snprintf(ref, sizeof(ref), "%.3f", (float)val / 1000.0);
+		CHECK(str(buf, fmtFix(buf, val, 3)) == ref);
+		snprintf(ref, sizeof(ref), "%.1f", (float)(val % 65536) / 10.0);
+		CHECK(str(buf, fmtFix(buf, val % 65536, 1)) == ref);
+	}
+}
+
+
+static void testPrefixes() {
+	cfgCntWb     = 3;
+	cfgMqttLp[0] = 1;
+	cfgMqttLp[1] = 0;              // not published
+	cfgMqttLp[2] = 12;
+	buildPrefixes();
+	CHECK(prefixLen[1][FAM_OWB] == 0);
+	char ref[30];
+	for (uint8_t i = 0; i < cfgCntWb; i++) {
+		for (uint8_t f = 0; f < FAM_CNT && cfgMqttLp[i]; f++) {
+			snprintf(ref, sizeof(ref), famFormat[f], cfgMqttLp[i]);
+			CHECK(std::string(&prefixPool[prefixOfs[i][f]], prefixLen[i][f]) == ref);
+		}
+	}
+}
+
+
+static void bench() {
+	// one topic and value of mqtt_publish(): kWhCounter of loadpoint 12
+	char     topic[50];
+	char     value[20];
+	uint32_t energy = 1234567;
+
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t n = 0; n < BENCH_CNT; n++) {
+		char header[30];
+		snprintf(header, sizeof(header), "openWB/set/lp/%d", cfgMqttLp[2]);
+		snprintf(topic, sizeof(topic), "%s/kWhCounter", header);
+		sink += snprintf(value, sizeof(value), "%.3f", (float)(energy + n) / 1000.0);
+	}
+	double old = nsPerOp(start);
+
+	start = std::chrono::steady_clock::now();
+	for (uint32_t n = 0; n < BENCH_CNT; n++) {
+		memcpy(topicBuf, &prefixPool[prefixOfs[2][FAM_OWB]], prefixLen[2][FAM_OWB]);
+		strcpy(&topicBuf[prefixLen[2][FAM_OWB]], "/kWhCounter");
+		sink += fmtFix(valueBuf, energy + n, 3);
+	}
+	double now = nsPerOp(start);
+	printf("topic + kWh value: snprintf %.1f ns, prefix + fmtFix %.1f ns (%.1fx)\n", old, now, old / now);
+
+	start = std::chrono::steady_clock::now();
+	for (uint32_t n = 0; n < BENCH_CNT; n++) {
+		sink += snprintf(value, sizeof(value), "%d", (uint16_t)(energy + n));
+	}
+	old = nsPerOp(start);
+	start = std::chrono::steady_clock::now();
+	for (uint32_t n = 0; n < BENCH_CNT; n++) {
+		sink += fmtUint(valueBuf, (uint16_t)(energy + n));
+	}
+	now = nsPerOp(start);
+	printf("integer value:     snprintf %.1f ns, fmtUint %.1f ns (%.1fx)\n", old, now, old / now);
+}
+
+
+int main() {
+	testFormat();
+	testPrefixes();
+	bench();
+	return(hostResult());
+}
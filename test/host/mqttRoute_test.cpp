@@ -0,0 +1,93 @@
+// Copyright (c) 2023 steff393, MIT license
+// MQTT: routing of the received topics to the loadpoints
+
+#include "mqtt.cpp"
+#include "host.h"
+
+typedef struct {
+	uint8_t box;
+	uint8_t val;
+	uint8_t src;
+} request_t;
+
+static std::vector<request_t> requests;
+static int32_t watt = 0;
+
+void lm_storeRequest(uint8_t id, uint8_t val, uint8_t src) { requests.push_back({ id, val, src }); }
+void pv_setWatt(int32_t val)                               { watt = val; }
+
+// mqtt_begin() only configures the clients, there is no connection in this test
+PubSubClient& PubSubClient::setServer(const char *domain, uint16_t port)  { return(*this); }
+PubSubClient& PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE)          { return(*this); }
+PubSubClient& PubSubClient::setSocketTimeout(uint16_t timeout)            { return(*this); }
+bool          PubSubClient::setBufferSize(uint16_t size)                  { return(true); }
+IPAddress     AsyncClient::remoteIP()                                     { return(IPAddress()); }
+void          AsyncClient::onConnect(AcConnectHandler cb, void *arg)      {}
+void          AsyncClient::onError(AcErrorHandler cb, void *arg)          {}
+void          AsyncClient::onTimeout(AcTimeoutHandler cb, void *arg)      {}
+
+
+static boolean match(const char *pattern, const char *topic, uint16_t expLp) {
+	uint16_t lp = 0xFFFF;
+	return(routeMatch(pattern, topic, &lp) && lp == expLp);
+}
+
+
+static void receive(const char *topic, const char *payload) {
+	requests.clear();
+	callback((char *)topic, (byte *)payload, strlen(payload));
+}
+
+
+static void testMatch() {
+	CHECK( match("wbec/lp/+/enable", "wbec/lp/1/enable", 1));
+	CHECK( match("wbec/lp/+/enable", "wbec/lp/12/enable", 12));
+	CHECK( match("wbec/lp/+/enable", "wbec/lp/007/enable", 7));
+	CHECK( match("wbec/lp/+/enable", "wbec/lp/32/enable", MQTT_MAX_LP));
+	CHECK(!match("wbec/lp/+/enable", "wbec/lp/33/enable", 33));              // above MQTT_MAX_LP
+	CHECK(!match("wbec/lp/+/enable", "wbec/lp/99999999999/enable", 0));      // no overflow
+	CHECK(!match("wbec/lp/+/enable", "wbec/lp//enable", 0));
+	CHECK(!match("wbec/lp/+/enable", "wbec/lp/x/enable", 0));
+	CHECK(!match("wbec/lp/+/enable", "wbec/lp/1x/enable", 1));
+	CHECK(!match("wbec/lp/+/enable", "wbec/lp/1/enabled", 1));
+	CHECK(!match("wbec/lp/+/enable", "wbec/lp/1/enabl", 1));
+	CHECK(!match("wbec/lp/+/enable", "wbec/lp/1", 1));
+	CHECK(!match("wbec/lp/+/enable", "", 0));
+}
+
+
+static void testCallback() {
+	// box 0: loadpoint 1, box 1: none, box 2 and 3: loadpoint 12 (first box wins)
+	cfgCntWb     = 4;
+	cfgMqttLp[0] = 1;
+	cfgMqttLp[1] = 0;
+	cfgMqttLp[2] = 12;
+	cfgMqttLp[3] = 12;
+	strcpy(cfgMqttWattTopic, "pv/watt");
+	strcpy(cfgMqttWattJson, "");
+	mqtt_begin();
+
+	receive("openWB/lp/1/AConfigured", "16");
+	CHECK(requests.size() == 1 && requests[0].box == 0 && requests[0].val == 160 && requests[0].src == LM_SRC_OPENWB);
+	receive("openWB/chargepoint/12/set/current", "12.34");
+	CHECK(requests.size() == 1 && requests[0].box == 2 && requests[0].val == 123 && requests[0].src == LM_SRC_OPENWB2);
+	receive("wbec/lp/12/maxcurrent", "8");
+	CHECK(requests.size() == 1 && requests[0].box == 2 && requests[0].val == 80 && requests[0].src == LM_SRC_EVCC);
+	receive("wbec/lp/12/enable", "false");
+	CHECK(requests.size() == 1 && requests[0].box == 2 && requests[0].val == 0);
+	receive("wbec/lp/12/enable", "true");
+	CHECK(requests.size() == 1 && requests[0].box == 2 && requests[0].val == CURR_ABS_MIN);   // limit of the box
+	receive("wbec/lp/2/maxcurrent", "8");        // no box with loadpoint 2
+	CHECK(requests.empty());
+	receive("wbec/lp/1/maxcurrent", "3");        // below CURR_ABS_MIN
+	CHECK(requests.empty());
+	receive("pv/watt", "-1234");
+	CHECK(requests.empty() && watt == -1234);
+}
+
+
+int main() {
+	testMatch();
+	testCallback();
+	return(hostResult());
+}
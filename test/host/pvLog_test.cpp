@@ -0,0 +1,152 @@
+// Copyright (c) 2023 steff393, MIT license
+// PV history: compression of the samples, segment files on LittleFS and queries
+
+#include "pvLog.cpp"
+#include "host.h"
+
+#define T0 1700000000UL
+
+typedef struct {
+	uint32_t time;
+	int16_t  watt;                 // [10W]
+	uint16_t power;
+} sample_t;
+
+static std::vector<sample_t> ref;
+
+
+static uint32_t count(pvQuery_t *q, uint32_t *last = nullptr) {
+	char     line[100];
+	uint32_t cnt = 0;
+	while (pvLog_queryNext(q, line, sizeof(line))) {
+		if (last) {
+			*last = strtoul(line, NULL, 10);
+		}
+		cnt++;
+	}
+	return(cnt);
+}
+
+
+static void testVarint() {
+	const int32_t val[] = { 0, 1, -1, 63, -64, 64, -65, 8191, -8192, 8192, 1000000, INT32_MAX, INT32_MIN };
+	const uint8_t len[] = { 1, 1,  1,  1,   1,  2,   2,    2,     2,    3,       3,         5,         5 };
+	for (uint8_t i = 0; i < sizeof(val) / sizeof(val[0]); i++) {
+		uint8_t  p[8];
+		uint16_t pos = 0;
+		CHECK(putVarint(p, val[i]) == len[i]);
+		CHECK(getVarint(p, &pos) == val[i] && pos == len[i]);
+	}
+}
+
+
+static void testImport() {
+	// the history of former versions is taken over into an empty history, lines with errors are skipped
+	std::string csv;
+	for (uint32_t i = 0; i < 5000; i++) {
+		char line[64];
+		snprintf(line, sizeof(line), "%lu;%d;%d;60;80\r\n", T0 + i * 30, (int)(i % 50) * 10 - 250, (int)(i % 7) * 100);
+		csv += line;
+	}
+	csv += "garbage\r\n1;2\r\n";
+	hostFs[PVLOG_CSV_FILE].assign(csv.begin(), csv.end());
+	pvLog_setup();
+	CHECK(!hostFs.count(PVLOG_CSV_FILE));
+
+	pvQuery_t q;
+	char      line[100];
+	uint32_t  cnt = 0;
+	boolean   ok  = true;
+	pvLog_queryBegin(&q, 0, UINT32_MAX, 0);
+	while (pvLog_queryNext(&q, line, sizeof(line))) {
+		unsigned long time;
+		long          watt;
+		unsigned      power;
+		sscanf(line, "%lu;%ld;%u", &time, &watt, &power);
+		ok = ok && time == T0 + cnt * 30 && watt == (long)(cnt % 50) * 10 - 250 && power == cnt % 7 * 100;
+		cnt++;
+	}
+	CHECK(ok && cnt == 5000);
+
+	// when a history exists, the file is only removed
+	hostFs[PVLOG_CSV_FILE].assign(csv.begin(), csv.end());
+	pvLog_setup();
+	CHECK(!hostFs.count(PVLOG_CSV_FILE));
+	pvLog_queryBegin(&q, 0, UINT32_MAX, 0);
+	CHECK(count(&q) == 5000);
+}
+
+
+static void reset() {
+	hostFs.clear();
+	hostFsRewrites.clear();
+	memset(acc, 0, sizeof(acc));
+	memset(pending, 0, sizeof(pending));
+	pvLog_setup();
+}
+
+
+static void testSegments() {
+	// samples of more than a week with restarts: level 0 wraps around, the segments are only appended
+	uint32_t time = T0;
+	srand(1);
+	reset();
+	for (uint32_t i = 0; i < 60000; i++) {
+		time += 30 + (rand() % 7 == 0 ? rand() % 5 - 2 : 0);
+		int32_t  watt  = (rand() % 3 == 0) ? rand() % 8000 - 4000 : (ref.empty() ? 0 : ref.back().watt * 10);
+		uint16_t power = (rand() % 5 == 0) ? rand() % 11000 : (ref.empty() ? 0 : ref.back().power);
+		hostTime += 30000;
+		pvLog_add(time, watt, power);
+		pvLog_loop();
+		ref.push_back({ time, (int16_t)((watt + (watt >= 0 ? 5 : -5)) / 10), power });
+		if (i == 20000 || i == 45001) {
+			pvLog_flush(true);
+			pvLog_setup();
+		}
+	}
+	hostFsRewrites.erase(PVLOG_CUR_FILE);   // only this small file is overwritten
+	CHECK(hostFsRewrites.empty());
+	for (uint8_t l = 0; l < PVLOG_LEVEL_CNT; l++) {
+		CHECK(next[l] / segRecs(l) - firstSeg[l] < level[l].segCnt);
+	}
+	CHECK(firstSeg[0] > 0);        // wrapped around
+
+	// every sample of level 0 is decoded, incl. the ones still in RAM
+	pvQuery_t q;
+	char      line[100];
+	uint32_t  cnt   = 0;
+	size_t    first = SIZE_MAX;
+	boolean   ok    = true;
+	pvLog_queryBegin(&q, 0, UINT32_MAX, 0);
+	while (pvLog_queryNext(&q, line, sizeof(line))) {
+		unsigned long t;
+		long          watt;
+		unsigned      power;
+		sscanf(line, "%lu;%ld;%u", &t, &watt, &power);
+		if (first == SIZE_MAX) {
+			for (first = 0; first < ref.size() && ref[first].time != t; first++);
+		}
+		ok = ok && first + cnt < ref.size() && ref[first + cnt].time == t && ref[first + cnt].watt * 10 == watt && ref[first + cnt].power == power;
+		cnt++;
+	}
+	CHECK(ok && first > 0 && first + cnt == ref.size());
+
+	// range, reduced to points of a coarser level
+	pvLog_queryBegin(&q, ref[59000].time, ref[59500].time, 0);
+	CHECK(count(&q) == 501);
+	pvLog_queryBegin(&q, ref[59000].time, ref[59500].time, 100);
+	CHECK(q.level == 0 && count(&q) == 101);                     // 150s per point
+	pvLog_queryBegin(&q, ref[58000].time, ref[59500].time, 100);
+	CHECK(q.level == 1 && count(&q) <= 101);                     // > 300s per point
+	uint32_t last = 0;
+	pvLog_queryBegin(&q, ref[0].time, time, 500);
+	CHECK(q.level == 2 && count(&q, &last) <= 501 && last + 3 * 3600 > time);   // the open hour is not yet written
+}
+
+
+int main() {
+	testVarint();
+	testImport();
+	testSegments();
+	return(hostResult());
+}
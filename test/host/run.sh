@@ -0,0 +1,29 @@
+#!/bin/sh
+# Host tests: every *_test.cpp includes the module under test (to reach its static functions) and runs
+# on the PC. The Arduino core and the libraries are replaced by stubs/ and host.cpp, the configuration
+# variables come from globalConfig.cpp. Unused code is removed by the linker, so only the functions,
+# which are called, need a stub.
+# Usage: test/host/run.sh [name_test.cpp ...]     (needs g++, the binaries are built in $OUT)
+set -e
+cd "$(dirname "$0")"
+CXX=${CXX:-g++}
+OUT=${OUT:-/tmp/wbec-host}
+FLAGS="-std=gnu++17 -O2 -w -ffunction-sections -fdata-sections -DWBEC_VERSION_MAJOR=0 -Istubs -I. -I../../src"
+mkdir -p "$OUT"
+$CXX $FLAGS -c ../../src/globalConfig.cpp -o "$OUT/globalConfig.o"
+$CXX $FLAGS -c host.cpp -o "$OUT/host.o"
+if [ $# -eq 0 ]; then
+	set -- *_test.cpp
+fi
+fail=0
+for t in "$@"; do
+	name=$(basename "$t" .cpp)
+	$CXX $FLAGS "$t" "$OUT/globalConfig.o" "$OUT/host.o" -Wl,--gc-sections -o "$OUT/$name"
+	if "$OUT/$name"; then
+		echo "$name: ok"
+	else
+		echo "$name: FAILED"
+		fail=1
+	fi
+done
+exit $fail
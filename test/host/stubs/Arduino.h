@@ -0,0 +1,123 @@
+// Copyright (c) 2023 steff393, MIT license
+// Host tests: minimal replacement of the Arduino core, see test/host/run.sh
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <functional>
+#include <memory>
+#include <string>
+
+typedef bool    boolean;
+typedef uint8_t byte;
+
+#define PROGMEM
+#define PGM_P              const char*
+#define PSTR(s)            (s)
+#define F(s)               (s)
+#define snprintf_P         snprintf
+#define vsnprintf_P        vsnprintf
+#define sprintf_P          sprintf
+#define strcpy_P           strcpy
+#define strncpy_P          strncpy
+#define strcat_P           strcat
+#define strlen_P           strlen
+#define strcmp_P           strcmp
+#define strstr_P           strstr
+#define memcpy_P           memcpy
+#define pgm_read_byte(p)   (*(const uint8_t*)(p))
+#define pgm_read_word(p)   (*(const uint16_t*)(p))
+#define pgm_read_dword(p)  (*(const uint32_t*)(p))
+#define pgm_read_ptr(p)    (*(void* const*)(p))
+#define HEX 16
+#define DEC 10
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+class __FlashStringHelper;
+
+class String {
+public:
+	std::string v;
+	String() {}
+	String(const char *s) : v(s ? s : "") {}
+	String(const __FlashStringHelper *s) : v((const char*)s) {}
+	String(int val, int base = 10)           : v(base == 10 ? std::to_string(val) : num(val, base)) {}
+	String(unsigned val, int base = 10)      : v(base == 10 ? std::to_string(val) : num(val, base)) {}
+	String(long val, int base = 10)          : v(base == 10 ? std::to_string(val) : num(val, base)) {}
+	String(unsigned long val, int base = 10) : v(base == 10 ? std::to_string(val) : num(val, base)) {}
+	String(float val, int dec = 2)           { char b[32]; snprintf(b, sizeof(b), "%.*f", dec, val); v = b; }
+	String(double val, int dec = 2)          { char b[32]; snprintf(b, sizeof(b), "%.*f", dec, val); v = b; }
+	const char* c_str() const                { return(v.c_str()); }
+	unsigned length() const                  { return(v.length()); }
+	bool reserve(unsigned n)                 { v.reserve(n); return(true); }
+	bool concat(const char *s, unsigned n)   { v.append(s, n); return(true); }
+	long toInt() const                       { return(atol(v.c_str())); }
+	String& operator+=(const String &s)      { v += s.v; return(*this); }
+	String& operator+=(const char *s)        { v += s; return(*this); }
+	String& operator+=(char c)               { v += c; return(*this); }
+	String operator+(const String &s) const { String r(*this); r += s; return(r); }
+	String operator+(const char *s) const    { String r(*this); r += s; return(r); }
+	bool operator==(const char *s) const     { return(v == s); }
+	bool operator==(const String &s) const   { return(v == s.v); }
+private:
+	static std::string num(unsigned long val, int base) { char b[34]; snprintf(b, sizeof(b), base == 16 ? "%lx" : "%lu", val); return(b); }
+};
+
+class Print {
+public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t) = 0;
+	virtual size_t write(const uint8_t *buf, size_t size) { size_t n = 0; while (size--) { n += write(*buf++); } return(n); }
+	size_t print(const char *s) { return(write((const uint8_t*)s, strlen(s))); }
+};
+
+class Stream : public Print {
+public:
+	virtual int available() { return(0); }
+	virtual int read()      { return(-1); }
+};
+
+class IPAddress {
+public:
+	IPAddress() {}
+	IPAddress(uint32_t a) : addr(a) {}
+	IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : addr(a | b << 8 | c << 16 | (uint32_t)d << 24) {}
+	operator uint32_t() const { return(addr); }
+	String toString() const { char b[16]; snprintf(b, sizeof(b), "%u.%u.%u.%u", addr & 0xFF, addr >> 8 & 0xFF, addr >> 16 & 0xFF, addr >> 24); return(String(b)); }
+	bool fromString(const char*) { return(false); }
+private:
+	uint32_t addr = 0;
+};
+
+struct HardwareSerial {
+	void printf(const char*, ...) {}
+	template<class T> void print(T) {}
+	template<class T> void println(T) {}
+	void println() {}
+};
+extern HardwareSerial Serial;
+
+struct EspClass {
+	uint32_t getFreeHeap()         { return(40000); }
+	uint16_t getMaxFreeBlockSize() { return(20000); }
+	void restart() {}
+};
+extern EspClass ESP;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+long random(long max);
+long random(long min, long max);
+size_t strlcpy(char *dst, const char *src, size_t size);
+
+template<class T> T min(T a, T b) { return(a < b ? a : b); }
+template<class T> T max(T a, T b) { return(a > b ? a : b); }
+
+#endif /* ARDUINO_H */
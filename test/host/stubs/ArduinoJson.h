@@ -0,0 +1,46 @@
+// Copyright (c) 2023 steff393, MIT license
+// Host tests: declarations only, so that modules with JSON output compile. The tests don't call these
+// functions, their unresolved references are removed by --gc-sections.
+#ifndef ARDUINOJSON_H
+#define ARDUINOJSON_H
+
+#include <Arduino.h>
+
+#define JSON_OBJECT_SIZE(n) ((n) * 16)
+#define JSON_ARRAY_SIZE(n)  ((n) * 16)
+
+class JsonVariant {
+public:
+	template<class T> T operator|(T def) const;
+	template<class T> JsonVariant& operator=(const T &val);
+	template<class T> T as() const;
+	template<class T> operator T() const;
+	template<class T> bool add(const T &val);
+	template<class T> JsonVariant operator[](T key) const;
+	JsonVariant createNestedArray(const char *key = nullptr);
+	JsonVariant createNestedObject(const char *key = nullptr);
+	size_t size() const;
+	bool isNull() const;
+};
+typedef JsonVariant JsonObject;
+typedef JsonVariant JsonArray;
+
+class JsonDocument : public JsonVariant {};
+
+class DynamicJsonDocument : public JsonDocument {
+public:
+	DynamicJsonDocument(size_t capacity);
+};
+
+template<size_t N> class StaticJsonDocument : public JsonDocument {};
+
+class DeserializationError {
+public:
+	operator bool() const;
+	const char* c_str() const;
+};
+
+template<class... A> DeserializationError deserializeJson(JsonDocument &doc, A... input);
+template<class D> size_t serializeJson(const JsonDocument &doc, D &dst);
+
+#endif /* ARDUINOJSON_H */
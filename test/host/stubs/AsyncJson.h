@@ -0,0 +1,2 @@
+// Copyright (c) 2023 steff393, MIT license
+// Host tests: empty, ArduinoJson.h has the declarations
@@ -0,0 +1,35 @@
+// Copyright (c) 2023 steff393, MIT license
+// Host tests: declarations only, the tests don't use the network
+#ifndef ESP8266WIFI_H
+#define ESP8266WIFI_H
+
+#include <Arduino.h>
+
+class Client : public Stream {
+public:
+	virtual int     connect(IPAddress, uint16_t)   { return(0); }
+	virtual int     connect(const char*, uint16_t) { return(0); }
+	virtual uint8_t connected()                    { return(0); }
+	virtual void    stop() {}
+	size_t write(uint8_t) { return(0); }
+	using Print::write;
+};
+
+class WiFiClient : public Client {
+public:
+	void setTimeout(unsigned long) {}
+};
+
+#define WL_CONNECTED 3
+
+struct WiFiClass {
+	int       status();
+	int32_t   RSSI();
+	int32_t   channel();
+	IPAddress localIP();
+	bool      isConnected();
+	String    macAddress();
+};
+extern WiFiClass WiFi;
+
+#endif /* ESP8266WIFI_H */
@@ -0,0 +1,28 @@
+// Copyright (c) 2023 steff393, MIT license
+// Host tests: declarations only, the tests don't use the network
+#ifndef ESPASYNCTCP_H
+#define ESPASYNCTCP_H
+
+#include <ESP8266WiFi.h>
+
+class AsyncClient;
+typedef std::function<void(void*, AsyncClient*)>                AcConnectHandler;
+typedef std::function<void(void*, AsyncClient*, int8_t)>        AcErrorHandler;
+typedef std::function<void(void*, AsyncClient*, uint32_t)>      AcTimeoutHandler;
+typedef std::function<void(void*, AsyncClient*, void*, size_t)> AcDataHandler;
+
+class AsyncClient {
+public:
+	bool      connect(const char *host, uint16_t port);
+	bool      connect(IPAddress ip, uint16_t port);
+	void      close(bool now = false);
+	bool      connected();
+	IPAddress remoteIP();
+	void      onConnect(AcConnectHandler cb, void *arg = 0);
+	void      onDisconnect(AcConnectHandler cb, void *arg = 0);
+	void      onError(AcErrorHandler cb, void *arg = 0);
+	void      onTimeout(AcTimeoutHandler cb, void *arg = 0);
+	void      onData(AcDataHandler cb, void *arg = 0);
+};
+
+#endif /* ESPASYNCTCP_H */
@@ -0,0 +1,58 @@
+// Copyright (c) 2023 steff393, MIT license
+// Host tests: LittleFS in RAM, implemented in test/host/host.cpp
+#ifndef LITTLEFS_H
+#define LITTLEFS_H
+
+#include <Arduino.h>
+
+#define SeekSet 0
+#define SeekEnd 2
+
+class File : public Stream {
+public:
+	int    id  = -1;               // index of the name in the file system, -1 = not open
+	size_t pos = 0;
+	operator bool() const;
+	size_t size();
+	bool   seek(uint32_t pos, int mode = SeekSet);
+	size_t position() { return(pos); }
+	size_t read(uint8_t *buf, size_t size);
+	int    read();
+	int    available();
+	size_t readBytes(char *buf, size_t size) { return(read((uint8_t*)buf, size)); }
+	size_t write(const uint8_t *buf, size_t size);
+	size_t write(uint8_t c) { return(write(&c, 1)); }
+	void   flush() {}
+	void   close() {}
+};
+
+class Dir {
+public:
+	bool   next();
+	String fileName();
+	size_t fileSize();
+	std::string path;              // directory incl. '/'
+	int    idx = -1;
+};
+
+struct FSInfo {
+	size_t totalBytes;
+	size_t usedBytes;
+};
+
+class FS {
+public:
+	bool begin() { return(true); }
+	File open(const char *path, const char *mode);
+	File open(const String &path, const char *mode) { return(open(path.c_str(), mode)); }
+	bool exists(const char *path);
+	bool exists(const String &path) { return(exists(path.c_str())); }
+	bool remove(const char *path);
+	bool remove(const String &path) { return(remove(path.c_str())); }
+	bool rename(const char *from, const char *to);
+	bool info(FSInfo &info);
+	Dir  openDir(const char *path);
+};
+extern FS LittleFS;
+
+#endif /* LITTLEFS_H */
@@ -0,0 +1,113 @@
+// Copyright (c) 2023 steff393, MIT license
+// Host tests: simulated RTU master, a transaction stays in flight until the test (or 'regs') completes it
+#ifndef MODBUSRTU_H
+#define MODBUSRTU_H
+
+#include <Arduino.h>
+#include <vector>
+
+namespace Modbus {
+	enum ResultCode {
+		EX_SUCCESS                  = 0x00,
+		EX_ILLEGAL_FUNCTION         = 0x01,
+		EX_ILLEGAL_ADDRESS          = 0x02,
+		EX_ILLEGAL_VALUE            = 0x03,
+		EX_SLAVE_FAILURE            = 0x04,
+		EX_ACKNOWLEDGE              = 0x05,
+		EX_SLAVE_DEVICE_BUSY        = 0x06,
+		EX_PATH_UNAVAILABLE         = 0x0A,
+		EX_DEVICE_FAILED_TO_RESPOND = 0x0B,
+		EX_GENERAL_FAILURE          = 0xE1,
+		EX_TIMEOUT                  = 0xE4,
+		EX_PASSTHROUGH              = 0xE7
+	};
+	enum FunctionCode {
+		FC_READ_REGS       = 0x03,
+		FC_READ_INPUT_REGS = 0x04,
+		FC_WRITE_REG       = 0x06,
+		FC_WRITE_REGS      = 0x10,
+		FC_MASKWRITE_REG   = 0x16,
+		FC_READWRITE_REGS  = 0x17
+	};
+	struct frame_arg_t {
+		bool     to_server;
+		uint8_t  slaveId;
+		uint8_t  unitId;
+		uint32_t ipaddr;
+		uint16_t transactionId;
+	};
+}
+
+typedef bool (*cbTransaction)(Modbus::ResultCode event, uint16_t transactionId, void *data);
+typedef Modbus::ResultCode (*cbRaw)(uint8_t *data, uint8_t len, void *custom);
+
+class ModbusRTU {
+public:
+	uint8_t   sl  = 0;             // slave of the transaction in flight, 0 = none
+	uint8_t   fc  = 0;
+	uint16_t  reg = 0;
+	uint16_t  cnt = 0;
+	uint16_t *dst = nullptr;
+	std::vector<uint8_t> pdu;      // request of rawRequest()
+	uint32_t  sent = 0;            // number of requests
+	cbTransaction cb  = nullptr;
+	cbRaw         raw = nullptr;
+	// register values of the simulated slaves: task() answers readHreg/readIreg/writeHreg at once, when set
+	std::function<uint16_t(uint8_t slave, uint16_t reg)> regs;
+
+	template<class S> void begin(S*, int) {}
+	void    master() {}
+	void    onRaw(cbRaw c) { raw = c; }
+	uint8_t slave()        { return(sl); }
+
+	uint16_t readHreg(uint8_t s, uint16_t r, uint16_t *d, uint16_t n, cbTransaction c)          { return(start(s, 0x03, r, d, n, c)); }
+	uint16_t readIreg(uint8_t s, uint16_t r, uint16_t *d, uint16_t n, cbTransaction c)          { return(start(s, 0x04, r, d, n, c)); }
+	uint16_t writeHreg(uint8_t s, uint16_t r, uint16_t *v, uint16_t n, cbTransaction c)         { return(start(s, 0x06, r, nullptr, n, c)); }
+	uint16_t writeHreg(uint8_t s, uint16_t r, uint16_t *v, uint16_t n, cbTransaction c, uint8_t) { return(writeHreg(s, r, v, n, c)); }
+	bool rawRequest(uint8_t s, uint8_t *data, uint8_t len, cbTransaction c) {
+		start(s, data[0], 0, nullptr, 0, c);
+		pdu.assign(data, data + len);
+		return(true);
+	}
+
+	void task() {
+		if (sl && regs && pdu.empty()) {
+			for (uint16_t i = 0; dst && i < cnt; i++) {
+				dst[i] = regs(sl, reg + i);
+			}
+			finish(Modbus::EX_SUCCESS);
+		}
+	}
+	// response of the slave to a raw request, passed to the onRaw callback
+	void reply(const std::vector<uint8_t> &data) {
+		std::vector<uint8_t> d(data);
+		Modbus::frame_arg_t src = { false, sl, sl, 0, 0 };
+		if (raw) {
+			raw(d.data(), d.size(), &src);
+		}
+		finish(Modbus::EX_SUCCESS);
+	}
+	void timeout() {
+		finish(Modbus::EX_TIMEOUT);
+	}
+
+private:
+	uint16_t start(uint8_t s, uint8_t f, uint16_t r, uint16_t *d, uint16_t n, cbTransaction c) {
+		sl = s; fc = f; reg = r; dst = d; cnt = n; cb = c;
+		pdu.clear();
+		sent++;
+		return(1);
+	}
+	void finish(Modbus::ResultCode event) {
+		// slave() is still valid in the callback, like in the library
+		cbTransaction c = cb;
+		cb = nullptr;
+		if (c) {
+			c(event, 0, nullptr);
+		}
+		sl = 0;
+		pdu.clear();
+	}
+};
+
+#endif /* MODBUSRTU_H */
@@ -0,0 +1,40 @@
+// Copyright (c) 2023 steff393, MIT license
+// Host tests: simulated TCP server, the responses are collected for the test
+#ifndef MODBUSTCP_H
+#define MODBUSTCP_H
+
+#include <ModbusRTU.h>
+
+class ModbusTCP {
+public:
+	typedef struct {
+		uint16_t transId;
+		uint32_t ip;
+		std::vector<uint8_t> pdu;  // exception: fc | 0x80, code
+	} resp_t;
+	std::vector<resp_t> resp;
+	uint16_t transId = 0;
+	cbRaw    raw     = nullptr;
+
+	void server() {}
+	void task() {}
+	void onRaw(cbRaw c) { raw = c; }
+	void setTransactionId(uint16_t t) { transId = t; }
+	uint32_t eventSource() { return(0); }
+	bool disconnect(IPAddress) { return(true); }
+	uint16_t rawResponce(IPAddress ip, uint8_t *data, uint8_t len, uint8_t unit) {
+		resp.push_back({ transId, (uint32_t)ip, std::vector<uint8_t>(data, data + len) });
+		return(1);
+	}
+	uint16_t errorResponce(IPAddress ip, Modbus::FunctionCode fc, Modbus::ResultCode code) {
+		resp.push_back({ transId, (uint32_t)ip, { (uint8_t)(fc | 0x80), (uint8_t)code } });
+		return(1);
+	}
+	// request of a client, passed to the onRaw callback
+	Modbus::ResultCode request(uint32_t ip, uint16_t trans, uint8_t unit, std::vector<uint8_t> pdu) {
+		Modbus::frame_arg_t src = { true, unit, unit, ip, trans };
+		return(raw(pdu.data(), pdu.size(), &src));
+	}
+};
+
+#endif /* MODBUSTCP_H */
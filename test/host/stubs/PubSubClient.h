@@ -0,0 +1,32 @@
+// Copyright (c) 2023 steff393, MIT license
+// Host tests: publish() is implemented by the test, which needs it
+#ifndef PUBSUBCLIENT_H
+#define PUBSUBCLIENT_H
+
+#include <ESP8266WiFi.h>
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+class PubSubClient {
+public:
+	PubSubClient(Client&) {}
+	PubSubClient& setServer(const char *domain, uint16_t port);
+	PubSubClient& setServer(IPAddress ip, uint16_t port);
+	PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+	PubSubClient& setSocketTimeout(uint16_t timeout);
+	PubSubClient& setKeepAlive(uint16_t keepAlive);
+	bool setBufferSize(uint16_t size);
+	bool connect(const char *id);
+	bool connect(const char *id, const char *willTopic, uint8_t willQos, bool willRetain, const char *willMessage);
+	bool connect(const char *id, const char *user, const char *pass, const char *willTopic, uint8_t willQos, bool willRetain, const char *willMessage);
+	bool publish(const char *topic, const char *payload);
+	bool publish(const char *topic, const char *payload, bool retained);
+	bool publish(const char *topic, const uint8_t *payload, unsigned int plength, bool retained);
+	bool subscribe(const char *topic);
+	bool loop();
+	bool connected();
+	int  state();
+	void disconnect();
+};
+
+#endif /* PUBSUBCLIENT_H */
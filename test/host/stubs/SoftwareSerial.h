@@ -0,0 +1,14 @@
+// Copyright (c) 2023 steff393, MIT license
+// Host tests: the bus is simulated by ModbusRTU
+#ifndef SOFTWARESERIAL_H
+#define SOFTWARESERIAL_H
+
+#define SWSERIAL_8E1 0
+#define SWSERIAL_8N1 1
+
+class SoftwareSerial {
+public:
+	void begin(long, int, int, int) {}
+};
+
+#endif /* SOFTWARESERIAL_H */
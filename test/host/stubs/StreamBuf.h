@@ -0,0 +1,20 @@
+// Copyright (c) 2023 steff393, MIT license
+// Host tests: declarations only
+#ifndef STREAMBUF_H
+#define STREAMBUF_H
+
+#include <Arduino.h>
+
+class StreamBuf : public Stream {
+public:
+	StreamBuf(uint8_t*, uint32_t) {}
+	size_t write(uint8_t) { return(1); }
+};
+
+class DuplexBuf : public Stream {
+public:
+	DuplexBuf(Stream*, Stream*) {}
+	size_t write(uint8_t) { return(1); }
+};
+
+#endif /* STREAMBUF_H */